@@ -0,0 +1,119 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-12-01.
+ *
+ * benchmark/exec/contract_chains --
+ *   Measures the overhead of the steps of contracts, with chains of 2, 8 and
+ *   32 steps, each doing a little work on a pooled buffer.
+ *   Either every step is posted to the executor as a new job by the step
+ *   before it, or the chain is run by the contract engine, which runs the
+ *   next step on the same thread. Every measurement runs chain_count chains,
+ *   so the overhead of a step is the time divided by chain_count times the
+ *   length of the chains.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include <haven/exec/contract-engine.hxx>
+#include <haven/exec/executor.hxx>
+#include <haven/mem/pool.hxx>
+
+#define NONIUS_RUNNER
+#include <nonius/nonius.h++>
+
+namespace {
+    constexpr const auto chain_count = 1'000;
+
+    using buffer_pool = hvn::pool<std::array<std::uint64_t, 8>>;
+
+    void
+    work_on(buffer_pool& buffers, hvn::pool_handle buf) noexcept {
+        for (auto& word : *buffers.resolve(buf)) word = word * 31 + 7;
+    }
+
+    void
+    requeued_step(hvn::executor& exec, buffer_pool& buffers, hvn::pool_handle buf, std::size_t left) {
+        work_on(buffers, buf);
+        if (left == 1) {
+            buffers.deallocate(buf);
+            return;
+        }
+        exec.post([&exec, &buffers, buf, left] { requeued_step(exec, buffers, buf, left - 1); });
+    }
+
+    template<std::size_t Steps>
+    void
+    bench_requeued(nonius::chronometer meter) {
+        hvn::executor exec;
+        buffer_pool buffers;
+        meter.measure([&] {
+            for (int i = 0; i < chain_count; ++i) {
+                auto buf = buffers.allocate_handle();
+                exec.post([&exec, &buffers, buf] { requeued_step(exec, buffers, buf, Steps); });
+            }
+            exec.wait_idle();
+        });
+    }
+
+    template<std::size_t... Idx>
+    hvn::contract
+    build_chain(hvn::contract_engine& engine, buffer_pool& buffers, std::index_sequence<Idx...>) {
+        auto step = [&buffers](hvn::pool_handle buf) noexcept {
+            work_on(buffers, buf);
+            return hvn::step_result::next(buf);
+        };
+        auto last = [&buffers](hvn::pool_handle buf) noexcept {
+            work_on(buffers, buf);
+            buffers.deallocate(buf);
+            return hvn::step_result::next({});
+        };
+        return engine.chain(((void) Idx, step)..., last);
+    }
+
+    template<std::size_t Steps>
+    void
+    bench_engine(nonius::chronometer meter) {
+        hvn::executor exec;
+        hvn::contract_engine engine(exec);
+        buffer_pool buffers;
+        meter.measure([&] {
+            for (int i = 0; i < chain_count; ++i) {
+                auto buf = buffers.allocate_handle();
+                exec.post([&engine, &buffers, buf] {
+                    engine.start(build_chain(engine, buffers, std::make_index_sequence<Steps - 1>{}), buf);
+                });
+            }
+            exec.wait_idle();
+        });
+    }
+}
+
+NONIUS_BENCHMARK("2 steps, re-queued", [](nonius::chronometer meter) {
+    bench_requeued<2>(meter);
+})
+
+NONIUS_BENCHMARK("2 steps, contract engine", [](nonius::chronometer meter) {
+    bench_engine<2>(meter);
+})
+
+NONIUS_BENCHMARK("8 steps, re-queued", [](nonius::chronometer meter) {
+    bench_requeued<8>(meter);
+})
+
+NONIUS_BENCHMARK("8 steps, contract engine", [](nonius::chronometer meter) {
+    bench_engine<8>(meter);
+})
+
+NONIUS_BENCHMARK("32 steps, re-queued", [](nonius::chronometer meter) {
+    bench_requeued<32>(meter);
+})
+
+NONIUS_BENCHMARK("32 steps, contract engine", [](nonius::chronometer meter) {
+    bench_engine<32>(meter);
+})
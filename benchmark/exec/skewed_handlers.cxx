@@ -0,0 +1,85 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-26.
+ *
+ * benchmark/exec/skewed_handlers --
+ *   Measures handling completions with skewed costs: every thread receives
+ *   the same number of completions, but the expensive ones all arrive at the
+ *   first thread. Either every thread runs the handlers of its completions
+ *   itself, as harbor threads would, or posts them to the work-stealing
+ *   executor, whose idle workers steal from the busy one.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <haven/exec/executor.hxx>
+
+#define NONIUS_RUNNER
+#include <nonius/nonius.h++>
+
+namespace {
+    constexpr const auto handlers_per_thread = 2'000;
+    constexpr const auto cheap_cost = 100;
+    constexpr const auto expensive_cost = 10'000;
+
+    std::atomic<std::uint64_t> sink{};
+
+    void
+    handle(int cost) noexcept {
+        std::uint64_t acc = 0x9E37'79B9'7F4A'7C15;
+        for (int i = 0; i < cost; ++i) {
+            acc ^= acc << 13;
+            acc ^= acc >> 7;
+            acc ^= acc << 17;
+        }
+        sink.fetch_add(acc, std::memory_order_relaxed);
+    }
+
+    // every tenth completion of the first thread is expensive
+    int
+    cost_of(std::size_t thread, int completion) noexcept {
+        return thread == 0 && completion % 10 == 0 ? expensive_cost : cheap_cost;
+    }
+
+    std::size_t
+    thread_count() noexcept {
+        return std::max(2u, std::thread::hardware_concurrency());
+    }
+}
+
+NONIUS_BENCHMARK("handlers run by the receiving thread", [](nonius::chronometer meter) {
+    auto threads = thread_count();
+    meter.measure([threads] {
+        std::vector<std::jthread> receivers;
+        for (std::size_t t = 0; t < threads; ++t) {
+            receivers.emplace_back([t] {
+                for (int i = 0; i < handlers_per_thread; ++i) {
+                    handle(cost_of(t, i));
+                }
+            });
+        }
+    });
+})
+
+NONIUS_BENCHMARK("handlers posted to the executor", [](nonius::chronometer meter) {
+    auto threads = thread_count();
+    hvn::executor exec(threads);
+    meter.measure([threads, &exec] {
+        // the receivers are tasks themselves, so they post to their own deques
+        for (std::size_t t = 0; t < threads; ++t) {
+            exec.post([t, &exec] {
+                for (int i = 0; i < handlers_per_thread; ++i) {
+                    exec.post([cost = cost_of(t, i)] { handle(cost); });
+                }
+            });
+        }
+        exec.wait_idle();
+    });
+})
@@ -0,0 +1,105 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-30.
+ *
+ * benchmark/io/file_dock --
+ *   Measures large sequential reads and writes through file docks in direct
+ *   and in buffered mode.
+ *   The file is created in the directory named by the HVN_BENCH_DIR
+ *   environment variable, or the temporary directory; to compare file
+ *   systems, run it once with a tmpfs mount and once with a mounted ext4
+ *   image, for example:
+ *     truncate -s 1G ext4.img && mkfs.ext4 -q ext4.img
+ *     mount -o loop ext4.img /mnt/hvn && HVN_BENCH_DIR=/mnt/hvn ./hvn-io-file-dock-bench
+ *   Buffered reads are served from the page cache when it holds the file,
+ *   which is the cost direct reads avoid imposing on other data.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <span>
+
+#include <haven/io/file-dock.hxx>
+#include <haven/mem/page-allocator.hxx>
+
+#define NONIUS_RUNNER
+#include <nonius/nonius.h++>
+
+namespace {
+    constexpr const auto file_size = std::uint64_t{64} << 20;
+    constexpr const auto block_pages = std::size_t{64};
+
+    std::filesystem::path
+    bench_file() {
+        auto dir = std::getenv("HVN_BENCH_DIR");
+        auto base = dir != nullptr ? std::filesystem::path(dir) : std::filesystem::temp_directory_path();
+        return base / "hvn-io-bench-dock.bin";
+    }
+
+    struct bench_block {
+        hvn::page_allocator alloc;
+        hvn::page_allocator::committed_page page = alloc.allocate(block_pages * alloc.page_size());
+
+        bench_block() {
+            auto bytes = span();
+            for (std::size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<std::byte>(i);
+        }
+        bench_block(const bench_block&) = delete;
+        ~bench_block() { alloc.deallocate(page); }
+
+        std::span<std::byte>
+        span() const noexcept { return {page.base_addr(), page.size()}; }
+    };
+
+    void
+    write_file(hvn::file_caching caching, std::span<const std::byte> block) {
+        hvn::file_dock dock(bench_file(), hvn::file_access::write, caching);
+        for (std::uint64_t offset = 0; offset < file_size; offset += block.size()) {
+            dock.write(block, offset);
+        }
+        dock.sync();
+    }
+
+    void
+    bench_write(nonius::chronometer meter, hvn::file_caching caching) {
+        bench_block block;
+        meter.measure([&] { write_file(caching, block.span()); });
+        std::filesystem::remove(bench_file());
+    }
+
+    void
+    bench_read(nonius::chronometer meter, hvn::file_caching caching) {
+        bench_block block;
+        write_file(hvn::file_caching::buffered, block.span());
+        meter.measure([&] {
+            hvn::file_dock dock(bench_file(), hvn::file_access::read, caching);
+            std::uint64_t total = 0;
+            for (std::uint64_t offset = 0; offset < file_size; offset += block.span().size()) {
+                total += dock.read(block.span(), offset);
+            }
+            return total;
+        });
+        std::filesystem::remove(bench_file());
+    }
+}
+
+NONIUS_BENCHMARK("sequential write, buffered", [](nonius::chronometer meter) {
+    bench_write(meter, hvn::file_caching::buffered);
+})
+
+NONIUS_BENCHMARK("sequential write, direct", [](nonius::chronometer meter) {
+    bench_write(meter, hvn::file_caching::direct);
+})
+
+NONIUS_BENCHMARK("sequential read, buffered", [](nonius::chronometer meter) {
+    bench_read(meter, hvn::file_caching::buffered);
+})
+
+NONIUS_BENCHMARK("sequential read, direct", [](nonius::chronometer meter) {
+    bench_read(meter, hvn::file_caching::direct);
+})
@@ -0,0 +1,94 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-29.
+ *
+ * benchmark/io/read_until --
+ *   Measures the throughput of framing a stream of page-sized read blocks by
+ *   delimiters, scanning the blocks with xsimd or with memchr.
+ *   Short lines put a delimiter into every few cache lines, long records only
+ *   into every few blocks.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <haven/io/read-until.hxx>
+#include <haven/mem/page-allocator.hxx>
+
+#define NONIUS_RUNNER
+#include <nonius/nonius.h++>
+
+namespace {
+    constexpr const auto input_size = std::size_t{8} << 20;
+
+    // the blocks only point into the input, so only the framing is measured
+    using block = const std::byte*;
+
+    std::vector<std::byte>
+    make_input(std::string_view delimiter, std::size_t average_frame) {
+        std::vector<std::byte> ret;
+        ret.reserve(input_size + average_frame * 2);
+        std::uint32_t rng = 0x2545'F491;
+        while (ret.size() < input_size) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            auto frame_size = average_frame / 2 + rng % average_frame;
+            for (std::size_t i = 0; i < frame_size; ++i) {
+                ret.push_back(static_cast<std::byte>('a' + (rng + i) % 26));
+            }
+            for (auto c : delimiter) ret.push_back(static_cast<std::byte>(c));
+        }
+        return ret;
+    }
+
+    template<class Scanner>
+    void
+    bench_framing(nonius::chronometer meter, std::string_view delimiter, std::size_t average_frame) {
+        auto input = make_input(delimiter, average_frame);
+        auto block_size = hvn::page_allocator::page_size();
+
+        meter.measure([&] {
+            hvn::delimiter_framer<block, Scanner> framer(delimiter);
+            std::size_t bytes = 0;
+            auto count = [&bytes](const auto& frame) { bytes += frame.size(); };
+            auto data = std::span<const std::byte>(input);
+            for (std::size_t i = 0; i < data.size(); i += block_size) {
+                auto read = data.subspan(i, std::min(block_size, data.size() - i));
+                framer.push(read.data(), read, count);
+            }
+            framer.finish(count);
+            return bytes;
+        });
+    }
+}
+
+NONIUS_BENCHMARK("LF lines (80 B), xsimd", [](nonius::chronometer meter) {
+    bench_framing<hvn::simd_scanner>(meter, "\n", 80);
+})
+
+NONIUS_BENCHMARK("LF lines (80 B), memchr", [](nonius::chronometer meter) {
+    bench_framing<hvn::memchr_scanner>(meter, "\n", 80);
+})
+
+NONIUS_BENCHMARK("CRLF lines (80 B), xsimd", [](nonius::chronometer meter) {
+    bench_framing<hvn::simd_scanner>(meter, "\r\n", 80);
+})
+
+NONIUS_BENCHMARK("CRLF lines (80 B), memchr", [](nonius::chronometer meter) {
+    bench_framing<hvn::memchr_scanner>(meter, "\r\n", 80);
+})
+
+NONIUS_BENCHMARK("NUL records (16 KiB), xsimd", [](nonius::chronometer meter) {
+    bench_framing<hvn::simd_scanner>(meter, std::string_view("\0", 1), 16 << 10);
+})
+
+NONIUS_BENCHMARK("NUL records (16 KiB), memchr", [](nonius::chronometer meter) {
+    bench_framing<hvn::memchr_scanner>(meter, std::string_view("\0", 1), 16 << 10);
+})
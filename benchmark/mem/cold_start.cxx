@@ -0,0 +1,84 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-25.
+ *
+ * benchmark/mem/cold_start --
+ *   Measures the latency of the first allocations of a freshly created pool,
+ *   as seen by the first requests after a deploy: without warm-up, after
+ *   reserving, and after reserving with the pages faulted in.
+ *   Nonius only reports means, but the interesting part here is the tail,
+ *   so every allocation is timed on its own and percentiles are printed.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include <haven/mem/pool.hxx>
+
+namespace {
+    constexpr const auto runs = 50;
+    constexpr const auto allocations_per_run = std::size_t{20'000};
+
+    struct job {
+        std::uint64_t id;
+        std::uint64_t payload[7];
+    };
+
+    using clock_type = std::chrono::steady_clock;
+
+    template<class Warmup>
+    void
+    measure(std::string_view name, Warmup&& warm_up) {
+        std::vector<std::int64_t> latencies;
+        latencies.reserve(runs * allocations_per_run);
+        std::vector<job*> jobs;
+        jobs.reserve(allocations_per_run);
+
+        for (int run = 0; run < runs; ++run) {
+            hvn::pool<job> pool;
+            warm_up(pool);
+
+            for (std::size_t i = 0; i < allocations_per_run; ++i) {
+                auto start = clock_type::now();
+                auto ptr = pool.allocate();
+                ptr->id = i; // the first write is where a lazy page faults
+                auto end = clock_type::now();
+
+                jobs.push_back(ptr);
+                latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            }
+            for (auto ptr : jobs) {
+                pool.deallocate(ptr);
+            }
+            jobs.clear();
+        }
+
+        std::ranges::sort(latencies);
+        auto percentile = [&latencies](double p) {
+            return latencies[static_cast<std::size_t>(p * static_cast<double>(latencies.size() - 1))];
+        };
+        std::cout << name << ":\n"
+                  << "\tp50:  " << percentile(.5) << " ns\n"
+                  << "\tp99:  " << percentile(.99) << " ns\n"
+                  << "\tp999: " << percentile(.999) << " ns\n"
+                  << "\tmax:  " << latencies.back() << " ns\n";
+    }
+}
+
+int
+main() {
+    measure("cold pool", [](auto&) { });
+    measure("reserved pool", [](auto& pool) {
+        pool.reserve(allocations_per_run);
+    });
+    measure("reserved and prefaulted pool", [](auto& pool) {
+        pool.reserve(allocations_per_run, hvn::page_prefault::populate);
+    });
+}
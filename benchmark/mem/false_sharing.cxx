@@ -0,0 +1,67 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-21.
+ *
+ * benchmark/mem/false_sharing --
+ *   Measures the cost of false sharing between objects allocated from the same
+ *   puddle and written concurrently by different threads, with the packed and
+ *   the cache line padded slot layouts.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <haven/mem/page-allocator.hxx>
+#include <haven/mem/puddle.hxx>
+#include <haven/mem/slot-layout.hxx>
+
+#define NONIUS_RUNNER
+#include <nonius/nonius.h++>
+
+namespace {
+    constexpr const auto writes_per_thread = 1'000'000;
+
+    struct counter {
+        std::atomic<std::uint64_t> value{};
+    };
+
+    template<class Layout>
+    void
+    concurrent_writes(nonius::chronometer meter) {
+        hvn::page_allocator alloc;
+        hvn::puddle<counter, hvn::page_allocator, Layout> puddle(&alloc);
+
+        auto threads = std::clamp<std::size_t>(std::thread::hardware_concurrency(),
+                                               2,
+                                               puddle.capacity());
+        std::vector<counter*> counters;
+        std::ranges::generate_n(std::back_inserter(counters), threads, [&puddle] {
+            return puddle.try_allocate();
+        });
+
+        meter.measure([&counters] {
+            std::vector<std::jthread> workers;
+            for (auto cnt : counters) {
+                workers.emplace_back([cnt] {
+                    for (int i = 0; i < writes_per_thread; ++i) {
+                        cnt->value.fetch_add(1, std::memory_order_relaxed);
+                    }
+                });
+            }
+        });
+
+        for (auto cnt : counters) {
+            std::ignore = puddle.deallocate(cnt);
+        }
+    }
+}
+
+NONIUS_BENCHMARK("puddle<packed_layout> concurrent writes", concurrent_writes<hvn::packed_layout>)
+NONIUS_BENCHMARK("puddle<cache_line_layout> concurrent writes", concurrent_writes<hvn::cache_line_layout>)
@@ -0,0 +1,91 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-24.
+ *
+ * benchmark/mem/mapped_file --
+ *   Compares pools backed by anonymous pages to pools backed by a mapped file,
+ *   and the cost of the page lifecycle operations of both allocators.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <tuple>
+#include <vector>
+
+#include <haven/mem/mapped-file-allocator.hxx>
+#include <haven/mem/page-allocator.hxx>
+#include <haven/mem/pool.hxx>
+
+#define NONIUS_RUNNER
+#include <nonius/nonius.h++>
+
+namespace {
+    constexpr const auto objects_per_run = 65'536;
+    constexpr const auto mapped_capacity_pages = std::size_t{16'384};
+
+    struct block {
+        std::uint64_t data[8];
+    };
+
+    std::filesystem::path
+    bench_file() {
+        return std::filesystem::temp_directory_path() / "hvn-mem-bench.map";
+    }
+
+    template<class Pool>
+    void
+    fill_and_drain(Pool& pool, nonius::chronometer& meter) {
+        std::vector<block*> buf(objects_per_run);
+        meter.measure([&pool, &buf] {
+            for (auto& ptr : buf) {
+                ptr = pool.allocate();
+                ptr->data[0] = 42;
+            }
+            for (auto ptr : buf) {
+                pool.deallocate(ptr);
+            }
+        });
+    }
+
+    template<class Allocator>
+    void
+    page_cycle(Allocator& alloc, nonius::chronometer& meter) {
+        auto page = alloc.allocate(alloc.page_size());
+        meter.measure([&alloc, &page] {
+            page.base_addr()[0] = std::byte{42};
+            page = alloc.commit(alloc.decommit(page));
+        });
+        alloc.deallocate(page);
+    }
+}
+
+NONIUS_BENCHMARK("pool<page_allocator> fill and drain", [](nonius::chronometer meter) {
+    hvn::pool<block> pool;
+    fill_and_drain(pool, meter);
+})
+
+NONIUS_BENCHMARK("pool<mapped_file_allocator> fill and drain", [](nonius::chronometer meter) {
+    {
+        hvn::pool<block, hvn::mapped_file_allocator> pool(std::in_place,
+                                                          bench_file(),
+                                                          mapped_capacity_pages * hvn::page_allocator::page_size());
+        fill_and_drain(pool, meter);
+    }
+    std::filesystem::remove(bench_file());
+})
+
+NONIUS_BENCHMARK("page_allocator commit/decommit", [](nonius::chronometer meter) {
+    hvn::page_allocator alloc;
+    page_cycle(alloc, meter);
+})
+
+NONIUS_BENCHMARK("mapped_file_allocator commit/decommit", [](nonius::chronometer meter) {
+    {
+        hvn::mapped_file_allocator alloc(bench_file(), mapped_capacity_pages * hvn::page_allocator::page_size());
+        page_cycle(alloc, meter);
+    }
+    std::filesystem::remove(bench_file());
+})
@@ -0,0 +1,88 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-22.
+ *
+ * benchmark/mem/remote_free --
+ *   Measures the producer/consumer pattern, where one thread allocates jobs
+ *   and another one frees them, with the mutex-based puddle and the
+ *   thread-owned puddle deferring remote frees.
+ */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include <haven/mem/owned-puddle.hxx>
+#include <haven/mem/page-allocator.hxx>
+#include <haven/mem/puddle.hxx>
+
+#define NONIUS_RUNNER
+#include <nonius/nonius.h++>
+
+namespace {
+    constexpr const auto jobs_per_run = 100'000;
+
+    struct job {
+        std::uint64_t id;
+        std::uint64_t payload;
+    };
+
+    // single-producer single-consumer ring used to hand jobs to the consumer
+    struct handoff {
+        bool
+        push(job* ptr) noexcept {
+            auto tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _head.load(std::memory_order_acquire) == _ring.size()) return false;
+            _ring[tail % _ring.size()] = ptr;
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        job*
+        pop() noexcept {
+            auto head = _head.load(std::memory_order_relaxed);
+            if (head == _tail.load(std::memory_order_acquire)) return nullptr;
+            auto ptr = _ring[head % _ring.size()];
+            _head.store(head + 1, std::memory_order_release);
+            return ptr;
+        }
+
+    private:
+        std::array<job*, 64> _ring{};
+        alignas(64) std::atomic<std::size_t> _head{};
+        alignas(64) std::atomic<std::size_t> _tail{};
+    };
+
+    template<class Puddle>
+    void
+    producer_consumer(nonius::chronometer meter) {
+        hvn::page_allocator alloc;
+        Puddle puddle(&alloc);
+
+        meter.measure([&puddle] {
+            handoff queue;
+            std::jthread consumer([&puddle, &queue] {
+                for (int freed = 0; freed < jobs_per_run;) {
+                    if (auto ptr = queue.pop()) {
+                        std::ignore = puddle.deallocate(ptr);
+                        ++freed;
+                    }
+                }
+            });
+
+            for (std::uint64_t i = 0; i < jobs_per_run;) {
+                auto ptr = puddle.try_allocate(i, i);
+                if (ptr == nullptr) continue;
+                while (!queue.push(ptr)) { }
+                ++i;
+            }
+        });
+    }
+}
+
+NONIUS_BENCHMARK("puddle producer/consumer", producer_consumer<hvn::puddle<job>>)
+NONIUS_BENCHMARK("owned_puddle producer/consumer", producer_consumer<hvn::owned_puddle<job>>)
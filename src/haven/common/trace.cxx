@@ -0,0 +1,250 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-28.
+ *
+ * src/haven/common/trace --
+ *   Implementation of the per-thread trace buffers and their export.
+ */
+
+#include "trace.hxx"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+    constexpr const auto buffer_capacity = std::uint64_t{1} << 14;
+    constexpr const auto dump_magic = std::array<char, 8>{'H', 'V', 'N', 'T', 'R', 'A', 'C', 'E'};
+    constexpr const auto dump_version = std::uint32_t{1};
+
+    // A single-producer ring of events. An event is two words, the timestamp
+    // and the rest packed together, so readers never see half of a word.
+    // Like in a seqlock, the producer claims a slot before writing it, so
+    // readers can tell whether what they copied was overwritten meanwhile.
+    struct trace_buffer {
+        explicit trace_buffer(std::uint32_t thread)
+             : thread(thread),
+               words(std::make_unique<std::atomic<std::uint64_t>[]>(2 * buffer_capacity)) { }
+
+        void
+        push(std::uint64_t timestamp, std::uint64_t packed) noexcept {
+            auto idx = head.load(std::memory_order_relaxed);
+            auto slot = 2 * (idx & (buffer_capacity - 1));
+            claimed.store(idx + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            words[slot].store(timestamp, std::memory_order_relaxed);
+            words[slot + 1].store(packed, std::memory_order_relaxed);
+            head.store(idx + 1, std::memory_order_release);
+        }
+
+        std::uint32_t thread;
+        std::atomic<std::uint64_t> head{};
+        std::atomic<std::uint64_t> claimed{};
+        std::atomic<std::uint64_t> cleared{};
+        std::unique_ptr<std::atomic<std::uint64_t>[]> words;
+    };
+
+    // buffers outlive their threads, so events of finished threads can be
+    // exported too; the registry itself is never destroyed, as threads may
+    // record events during static destruction
+    struct trace_registry {
+        std::mutex mx;
+        std::uint32_t next_thread = 0;
+        std::vector<std::shared_ptr<trace_buffer>> buffers;
+    };
+
+    trace_registry&
+    registry() {
+        static auto ret = new trace_registry;
+        return *ret;
+    }
+
+    trace_buffer*
+    this_thread_buffer() {
+        thread_local std::shared_ptr<trace_buffer> buffer = [] {
+            auto& reg = registry();
+            std::scoped_lock lck(reg.mx);
+            auto ret = std::make_shared<trace_buffer>(reg.next_thread++);
+            reg.buffers.push_back(ret);
+            return ret;
+        }();
+        return buffer.get();
+    }
+
+    std::uint64_t
+    pack(hvn::trace_event event, hvn::trace_phase phase, std::uint32_t arg) noexcept {
+        return std::uint64_t{arg}
+               | std::uint64_t{static_cast<std::uint16_t>(event)} << 32
+               | std::uint64_t{static_cast<std::uint8_t>(phase)} << 48;
+    }
+
+    hvn::trace_record
+    unpack(std::uint64_t timestamp, std::uint32_t thread, std::uint64_t packed) noexcept {
+        return {timestamp,
+                thread,
+                static_cast<std::uint32_t>(packed),
+                static_cast<hvn::trace_event>(packed >> 32 & 0xFFFF),
+                static_cast<hvn::trace_phase>(packed >> 48 & 0xFF)};
+    }
+
+    template<class T>
+    void
+    write_raw(std::ostream& os, T value) {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<class T>
+    T
+    read_raw(std::istream& is) {
+        T value;
+        if (!is.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+            throw std::runtime_error("truncated trace dump");
+        }
+        return value;
+    }
+}
+
+std::string_view
+hvn::trace_event_name(trace_event event) noexcept {
+    switch (event) {
+    case trace_event::pool_add_puddle: return "pool add puddle";
+    case trace_event::pool_deallocate_scan: return "pool deallocate scan";
+    case trace_event::puddle_retake_buffer: return "puddle retake buffer";
+    case trace_event::puddle_give_up_buffer: return "puddle give up buffer";
+    case trace_event::page_commit: return "page commit";
+    case trace_event::page_decommit: return "page decommit";
+    case trace_event::page_loan: return "page loan";
+    case trace_event::job_enqueue: return "job enqueue";
+    case trace_event::job_run: return "job run";
+    case trace_event::io_submit: return "io submit";
+    case trace_event::io_complete: return "io complete";
+    }
+    return "unknown";
+}
+
+void
+hvn::detail::trace_record_event(trace_event event, trace_phase phase, std::uint32_t arg) noexcept {
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch());
+    try {
+        this_thread_buffer()->push(static_cast<std::uint64_t>(now.count()), pack(event, phase, arg));
+    } catch (...) {
+        // could not set up the buffer of the thread, the event is lost
+    }
+}
+
+void
+hvn::trace_enable(bool on) noexcept {
+    detail::trace_on.store(on, std::memory_order_relaxed);
+}
+
+std::vector<hvn::trace_record>
+hvn::trace_snapshot() {
+    std::vector<std::shared_ptr<trace_buffer>> buffers;
+    {
+        auto& reg = registry();
+        std::scoped_lock lck(reg.mx);
+        buffers = reg.buffers;
+    }
+
+    std::vector<trace_record> ret;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> words;
+    for (auto& buffer : buffers) {
+        auto head = buffer->head.load(std::memory_order_acquire);
+        auto first = std::max(head > buffer_capacity ? head - buffer_capacity : 0,
+                              buffer->cleared.load(std::memory_order_relaxed));
+
+        words.clear();
+        for (auto idx = first; idx < head; ++idx) {
+            auto slot = 2 * (idx & (buffer_capacity - 1));
+            words.emplace_back(buffer->words[slot].load(std::memory_order_relaxed),
+                               buffer->words[slot + 1].load(std::memory_order_relaxed));
+        }
+
+        // the owner may have lapped us while copying, the slots it claimed
+        // since may hold anything
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto claimed = buffer->claimed.load(std::memory_order_relaxed);
+        auto valid_from = claimed > buffer_capacity ? claimed - buffer_capacity : 0;
+        for (auto idx = std::max(first, valid_from); idx < head; ++idx) {
+            auto [timestamp, packed] = words[idx - first];
+            ret.push_back(unpack(timestamp, buffer->thread, packed));
+        }
+    }
+
+    std::ranges::stable_sort(ret, {}, &trace_record::timestamp);
+    return ret;
+}
+
+void
+hvn::trace_clear() noexcept {
+    auto& reg = registry();
+    std::scoped_lock lck(reg.mx);
+    // nothing is left to export from the buffers of finished threads
+    std::erase_if(reg.buffers, [](const auto& buffer) { return buffer.use_count() == 1; });
+    for (auto& buffer : reg.buffers) {
+        buffer->cleared.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+void
+hvn::trace_dump(std::ostream& os, const std::vector<trace_record>& records) {
+    os.write(dump_magic.data(), dump_magic.size());
+    write_raw(os, dump_version);
+    write_raw(os, static_cast<std::uint64_t>(records.size()));
+    for (const auto& record : records) {
+        write_raw(os, record.timestamp);
+        write_raw(os, record.thread);
+        write_raw(os, record.arg);
+        write_raw(os, static_cast<std::uint16_t>(record.event));
+        write_raw(os, static_cast<std::uint8_t>(record.phase));
+    }
+}
+
+std::vector<hvn::trace_record>
+hvn::trace_load(std::istream& is) {
+    auto magic = read_raw<std::array<char, 8>>(is);
+    if (magic != dump_magic) throw std::runtime_error("not a libhaven trace dump");
+    if (read_raw<std::uint32_t>(is) != dump_version) throw std::runtime_error("unsupported trace dump version");
+
+    auto count = read_raw<std::uint64_t>(is);
+    std::vector<trace_record> ret;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        trace_record record{};
+        record.timestamp = read_raw<std::uint64_t>(is);
+        record.thread = read_raw<std::uint32_t>(is);
+        record.arg = read_raw<std::uint32_t>(is);
+        record.event = static_cast<trace_event>(read_raw<std::uint16_t>(is));
+        record.phase = static_cast<trace_phase>(read_raw<std::uint8_t>(is));
+        ret.push_back(record);
+    }
+    return ret;
+}
+
+void
+hvn::trace_write_chrome_json(std::ostream& os, const std::vector<trace_record>& records) {
+    os << R"({"displayTimeUnit":"ns","traceEvents":[)";
+    auto first = true;
+    for (const auto& record : records) {
+        if (!first) os << ',';
+        first = false;
+
+        auto phase = record.phase == trace_phase::begin ? "B"
+                     : record.phase == trace_phase::end ? "E"
+                                                        : "i";
+        os << R"({"name":")" << trace_event_name(record.event)
+           << R"(","ph":")" << phase
+           << R"(","ts":)" << record.timestamp / 1000 << '.' << record.timestamp % 1000 / 100 << record.timestamp % 100 / 10 << record.timestamp % 10
+           << R"(,"pid":1,"tid":)" << record.thread;
+        if (record.phase == trace_phase::instant) os << R"(,"s":"t")";
+        os << R"(,"args":{"arg":)" << record.arg << "}}";
+    }
+    os << "]}\n";
+}
@@ -0,0 +1,130 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-28.
+ *
+ * src/haven/common/trace --
+ *   Low-overhead binary event tracing.
+ *   Every thread records compact timestamped events into its own lock-free
+ *   ring buffer, overwriting the oldest ones when full. Tracing is switched
+ *   on and off at runtime; while off, recording an event is a single relaxed
+ *   load. Building without HAVEN_TRACE_EVENTS removes the events altogether.
+ *   The buffers can be dumped in a binary format, which the hvn-trace-export
+ *   tool converts to the Chrome trace JSON format, readable by Perfetto and
+ *   chrome://tracing.
+ */
+#ifndef LIBHAVEN_TRACE_HXX
+#define LIBHAVEN_TRACE_HXX
+
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace hvn {
+    enum class trace_event : std::uint16_t {
+        pool_add_puddle,
+        pool_deallocate_scan, // arg: the number of puddles searched past
+        puddle_retake_buffer,
+        puddle_give_up_buffer,
+        page_commit,
+        page_decommit,
+        page_loan,
+        job_enqueue, // arg: the id of the task, the same as its job_run's
+        job_run,
+        io_submit,
+        io_complete,
+    };
+
+    enum class trace_phase : std::uint8_t {
+        begin,
+        end,
+        instant,
+    };
+
+    [[nodiscard]] std::string_view
+    trace_event_name(trace_event event) noexcept;
+
+    struct trace_record {
+        std::uint64_t timestamp; // nanoseconds, steady clock
+        std::uint32_t thread;    // sequential id of the recording thread
+        std::uint32_t arg;       // event specific, like the size of a page
+        trace_event event;
+        trace_phase phase;
+    };
+
+    namespace detail {
+        inline std::atomic<bool> trace_on{false};
+
+        void
+        trace_record_event(trace_event event, trace_phase phase, std::uint32_t arg) noexcept;
+    }
+
+    void
+    trace_enable(bool on) noexcept;
+
+    [[nodiscard]] inline bool
+    trace_enabled() noexcept {
+        return detail::trace_on.load(std::memory_order_relaxed);
+    }
+
+    inline void
+    trace(trace_event event, trace_phase phase = trace_phase::instant, std::uint32_t arg = 0) noexcept {
+#ifdef HAVEN_TRACE_EVENTS
+        if (trace_enabled()) [[unlikely]] {
+            detail::trace_record_event(event, phase, arg);
+        }
+#else
+        (void) event;
+        (void) phase;
+        (void) arg;
+#endif
+    }
+
+    // records the beginning and the end of the enclosing scope
+    struct trace_scope {
+        explicit trace_scope(trace_event event, std::uint32_t arg = 0) noexcept
+             : _event(event),
+               _arg(arg) {
+            trace(_event, trace_phase::begin, _arg);
+        }
+
+        trace_scope(const trace_scope&) = delete;
+        trace_scope&
+        operator=(const trace_scope&) = delete;
+
+        ~trace_scope() noexcept {
+            trace(_event, trace_phase::end, _arg);
+        }
+
+    private:
+        trace_event _event;
+        std::uint32_t _arg;
+    };
+
+    // the events recorded by all threads since the last clear, which may
+    // still be running; events overwritten while reading are left out
+    [[nodiscard]] std::vector<trace_record>
+    trace_snapshot();
+
+    // forgets every event recorded so far
+    void
+    trace_clear() noexcept;
+
+    // the binary format written by trace_dump and read by trace_load
+    void
+    trace_dump(std::ostream& os, const std::vector<trace_record>& records);
+
+    // throws std::runtime_error if the stream is not a trace dump
+    [[nodiscard]] std::vector<trace_record>
+    trace_load(std::istream& is);
+
+    void
+    trace_write_chrome_json(std::ostream& os, const std::vector<trace_record>& records);
+}
+
+#endif
@@ -0,0 +1,85 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-12-01.
+ *
+ * src/haven/exec/contract-engine --
+ *   Implementation of running the chains of contracts.
+ */
+
+#include "contract-engine.hxx"
+
+#include "../common/check_conditions.hxx"
+#include "../common/trace.hxx"
+
+hvn::contract_engine::contract_engine(executor& exec, std::size_t inline_steps)
+     : _exec(&exec),
+       _inline_steps(inline_steps) {
+    precondition()([](auto steps) { return steps > 0; }, inline_steps);
+}
+
+hvn::contract_engine::~contract_engine() noexcept {
+    _nodes.for_each_allocated([this](step_node* step) {
+        step->destroy(step);
+        _nodes.deallocate(step);
+    });
+}
+
+hvn::pool_handle
+hvn::contract_engine::release(pool_handle node) noexcept {
+    auto step = _nodes.resolve(node);
+    auto next = step->next;
+    step->destroy(step);
+    _nodes.deallocate(node);
+    return next;
+}
+
+void
+hvn::contract_engine::advance(pool_handle node, pool_handle buffer) noexcept {
+    for (std::size_t steps = 0; node; ++steps) {
+        if (steps == _inline_steps) {
+            try {
+                _exec->post([this, node, buffer] { advance(node, buffer); });
+                return;
+            } catch (...) {
+                // the budget is only for fairness, the chain is not lost
+                steps = 0;
+            }
+        }
+
+        auto step = _nodes.resolve(node);
+        step_result res;
+        {
+            trace_scope scope(trace_event::job_run);
+            res = step->run(step, contract{node}, buffer);
+        }
+
+        switch (res.what) {
+        case step_result::kind::next:
+            buffer = res.buffer;
+            node = release(node);
+            break;
+        case step_result::kind::pending:
+            // the first to arrive leaves the chain to the other
+            if (step->arrivals.fetch_add(1, std::memory_order_acq_rel) == 0) return;
+            buffer = step->resumed;
+            node = release(node);
+            break;
+        case step_result::kind::stop:
+            while (node) node = release(node);
+            return;
+        }
+    }
+}
+
+void
+hvn::contract_engine::resume(contract self, pool_handle buffer) noexcept {
+    auto step = _nodes.resolve(self._node);
+    precondition()("only started contracts can be resumed"_msg, [step] { return step != nullptr; });
+
+    step->resumed = buffer;
+    if (step->arrivals.fetch_add(1, std::memory_order_acq_rel) == 0) return;
+    advance(release(self._node), buffer);
+}
@@ -0,0 +1,225 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-12-01.
+ *
+ * src/haven/exec/contract-engine --
+ *   Runs contracts: chains of steps that must run one after the other, like
+ *   read, transform, write.
+ *   Instead of queuing every step as a separate job, the thread finishing a
+ *   step runs the next one directly: the thread running the step if it
+ *   finished synchronously, or the thread completing the work it started.
+ *   Steps hand the buffer they work on to the next step as a pool_handle.
+ *   The nodes of the chains are allocated from a hvn::pool, and are linked
+ *   by handles.
+ *   After a number of steps run inline, the rest of the chain is posted to
+ *   the executor, so a long chain does not hold up its thread.
+ */
+#ifndef LIBHAVEN_CONTRACT_ENGINE_HXX
+#define LIBHAVEN_CONTRACT_ENGINE_HXX
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <haven/exec/executor.hxx>
+#include <haven/mem/page-allocator.hxx>
+#include <haven/mem/pool.hxx>
+#include <haven/mem/slot-layout.hxx>
+
+namespace hvn {
+    // What a step did with the buffer it was given.
+    struct step_result {
+        enum class kind : std::uint8_t {
+            next,
+            pending,
+            stop,
+        };
+
+        // the step is done, the buffer goes on to the next step
+        [[nodiscard]] static constexpr step_result
+        next(pool_handle buffer) noexcept { return {kind::next, buffer}; }
+
+        // the step started some work, which will resume the contract
+        [[nodiscard]] static constexpr step_result
+        pending() noexcept { return {kind::pending, {}}; }
+
+        // the contract ends here, the rest of its steps are dropped
+        [[nodiscard]] static constexpr step_result
+        stop() noexcept { return {kind::stop, {}}; }
+
+        kind what;
+        pool_handle buffer;
+    };
+
+    // A started chain of steps, as seen by its steps.
+    struct contract {
+        constexpr contract() noexcept = default;
+
+        constexpr explicit
+        operator bool() const noexcept { return static_cast<bool>(_node); }
+
+        friend constexpr bool
+        operator==(contract, contract) noexcept = default;
+
+    private:
+        constexpr explicit contract(pool_handle node) noexcept
+             : _node(node) { }
+
+        pool_handle _node{};
+
+        friend struct contract_engine;
+    };
+
+    template<class Fn>
+    concept contract_step =
+           std::invocable<Fn&, contract, pool_handle>
+           || std::invocable<Fn&, pool_handle>;
+
+    struct contract_engine {
+        // the number of steps run inline by default, before the rest of the
+        // chain is posted to the executor
+        constexpr const static auto default_inline_steps = std::size_t{64};
+
+        explicit contract_engine(executor& exec, std::size_t inline_steps = default_inline_steps);
+
+        contract_engine(const contract_engine&) = delete;
+        contract_engine&
+        operator=(const contract_engine&) = delete;
+
+        // releases the steps of the chains not yet started, or left pending,
+        // without running them
+        // nothing may run on the engine meanwhile: work posted to the executor
+        // is to be finished before
+        ~contract_engine() noexcept;
+
+        // builds a chain of the steps, to be run in order; nothing runs yet
+        // steps are called with the buffer handed over by the previous step,
+        // and optionally the contract itself to resume later; they must not
+        // throw, and the last step is responsible for releasing the buffer
+        template<contract_step... Steps>
+        [[nodiscard]] contract
+        chain(Steps&&... steps) {
+            static_assert(sizeof...(Steps) > 0, "a contract has at least one step");
+            pool_handle nodes[sizeof...(Steps)];
+            std::size_t built = 0;
+            try {
+                ((nodes[built] = make_node(std::forward<Steps>(steps)), ++built), ...);
+            } catch (...) {
+                for (std::size_t i = 0; i < built; ++i) release(nodes[i]);
+                throw;
+            }
+            for (std::size_t i = 0; i + 1 < built; ++i) {
+                _nodes.resolve(nodes[i])->next = nodes[i + 1];
+            }
+            return contract{nodes[0]};
+        }
+
+        // runs the chain on the calling thread with the buffer, until a step
+        // is pending or the chain ends
+        void
+        start(contract chain, pool_handle buffer) noexcept { advance(chain._node, buffer); }
+
+        // finishes the pending step of the contract, and runs the next steps
+        // on the calling thread
+        // if the step has not returned yet, its thread goes on instead
+        void
+        resume(contract self, pool_handle buffer) noexcept;
+
+        [[nodiscard]] std::size_t
+        inline_steps() const noexcept { return _inline_steps; }
+
+    private:
+        constexpr const static auto inline_size = std::size_t{32};
+
+        // a node fills a cache line: the step, the link to the next one, and
+        // the state of a pending step
+        struct step_node {
+            step_result (*run)(step_node*, contract, pool_handle) noexcept;
+            void (*destroy)(step_node*) noexcept;
+            pool_handle next{};
+            pool_handle resumed{};
+            // the pending step returning and its resumption both arrive here,
+            // the second one goes on with the chain
+            std::atomic<std::uint8_t> arrivals{};
+            alignas(std::max_align_t) std::byte storage[inline_size];
+        };
+
+        template<class Fn>
+        constexpr const static bool fits_inline = sizeof(Fn) <= inline_size
+                                                  && alignof(Fn) <= alignof(std::max_align_t);
+
+        template<class Fn>
+        static step_result
+        call(Fn& fn, contract self, pool_handle buffer) noexcept {
+            if constexpr (std::invocable<Fn&, contract, pool_handle>) {
+                return fn(self, buffer);
+            }
+            else {
+                return fn(buffer);
+            }
+        }
+
+        template<class Fn>
+        pool_handle
+        make_node(Fn&& fn) {
+            using fn_type = std::decay_t<Fn>;
+            auto handle = _nodes.allocate_handle();
+            auto node = _nodes.resolve(handle);
+            if constexpr (fits_inline<fn_type>) {
+                try {
+                    ::new (static_cast<void*>(node->storage)) fn_type(std::forward<Fn>(fn));
+                } catch (...) {
+                    _nodes.deallocate(handle);
+                    throw;
+                }
+                node->run = [](step_node* self, contract c, pool_handle buffer) noexcept {
+                    return call(*std::launder(reinterpret_cast<fn_type*>(self->storage)), c, buffer);
+                };
+                node->destroy = [](step_node* self) noexcept {
+                    std::destroy_at(std::launder(reinterpret_cast<fn_type*>(self->storage)));
+                };
+            }
+            else {
+                fn_type* heap_fn;
+                try {
+                    heap_fn = new fn_type(std::forward<Fn>(fn));
+                } catch (...) {
+                    _nodes.deallocate(handle);
+                    throw;
+                }
+                ::new (static_cast<void*>(node->storage)) fn_type*(heap_fn);
+                node->run = [](step_node* self, contract c, pool_handle buffer) noexcept {
+                    return call(**std::launder(reinterpret_cast<fn_type**>(self->storage)), c, buffer);
+                };
+                node->destroy = [](step_node* self) noexcept {
+                    delete *std::launder(reinterpret_cast<fn_type**>(self->storage));
+                };
+            }
+            return handle;
+        }
+
+        // runs the steps from the node on, until one is pending, the chain
+        // ends, or the inline budget runs out
+        // if the rest of the chain cannot be posted, it goes on inline
+        void
+        advance(pool_handle node, pool_handle buffer) noexcept;
+
+        // releases the node, returning the next one in its chain
+        pool_handle
+        release(pool_handle node) noexcept;
+
+        executor* _exec;
+        std::size_t _inline_steps;
+        pool<step_node, page_allocator, packed_layout> _nodes{};
+    };
+}
+
+#endif
@@ -0,0 +1,202 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-26.
+ *
+ * src/haven/exec/executor --
+ *   Implementation of the worker side of the work-stealing executor.
+ */
+
+#include "executor.hxx"
+
+#include <algorithm>
+#include <random>
+
+#include "../common/trace.hxx"
+
+namespace {
+    struct current_worker {
+        const hvn::executor* owner = nullptr;
+        std::size_t idx{};
+    };
+    thread_local current_worker this_worker{};
+
+    // tasks are cache line aligned, the rest of their address tells the
+    // living ones apart, so their enqueue and run events can be matched
+    std::uint32_t
+    trace_id(const void* task) noexcept {
+        return static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(task) >> 6);
+    }
+
+    std::uint64_t
+    xorshift(std::uint64_t& state) noexcept {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+}
+
+std::size_t
+hvn::executor::default_concurrency() noexcept {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+hvn::executor::executor(std::size_t workers) {
+    precondition()([](auto workers) { return workers > 0; }, workers);
+
+    std::random_device seed;
+    for (std::size_t i = 0; i < workers; ++i) {
+        auto w = std::make_unique<worker>();
+        // xorshift must not be seeded with zero
+        w->rng = (std::uint64_t{seed()} << 32 | seed()) | 1;
+        _workers.push_back(std::move(w));
+    }
+    _threads.reserve(workers);
+    for (std::size_t i = 0; i < workers; ++i) {
+        _threads.emplace_back([this, i] { work(i); });
+    }
+}
+
+hvn::executor::~executor() noexcept {
+    wait_idle();
+    {
+        std::scoped_lock lck(_sleep_mx);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    _threads.clear();
+}
+
+bool
+hvn::executor::is_worker() const noexcept {
+    return this_worker.owner == this;
+}
+
+void
+hvn::executor::schedule(task_node* task) {
+    trace(trace_event::job_enqueue, trace_phase::instant, trace_id(task));
+    _unfinished.fetch_add(1, std::memory_order_relaxed);
+    // counted before the task is visible, so running it never takes the
+    // count below zero
+    // pairs with the sleeper incrementing _sleepers before checking _queued:
+    // either the sleeper sees the task, or we see the sleeper
+    _queued.fetch_add(1, std::memory_order_seq_cst);
+    try {
+        if (is_worker()) {
+            _workers[this_worker.idx]->deque.push(task);
+        }
+        else {
+            std::scoped_lock lck(_inject_mx);
+            _injected.push_back(task);
+        }
+    } catch (...) {
+        // the queues could not grow
+        _queued.fetch_sub(1, std::memory_order_relaxed);
+        if (_unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            _unfinished.notify_all();
+        }
+        throw;
+    }
+
+    if (_sleepers.load(std::memory_order_seq_cst) > 0) {
+        std::scoped_lock lck(_sleep_mx);
+        _wake.notify_one();
+    }
+}
+
+hvn::executor::task_node*
+hvn::executor::steal_task(std::uint64_t& rng, const worker* self) {
+    auto count = _workers.size();
+    auto start = static_cast<std::size_t>(xorshift(rng) % count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto& victim = _workers[(start + i) % count];
+        if (victim.get() == self) continue;
+        if (auto task = victim->deque.steal()) return task;
+    }
+    return nullptr;
+}
+
+hvn::executor::task_node*
+hvn::executor::find_task(worker* self) {
+    if (self != nullptr) {
+        if (auto task = self->deque.pop()) return task;
+    }
+    {
+        std::unique_lock lck(_inject_mx, std::try_to_lock);
+        if (lck.owns_lock() && !_injected.empty()) {
+            auto task = _injected.front();
+            _injected.pop_front();
+            return task;
+        }
+    }
+
+    if (self != nullptr) return steal_task(self->rng, self);
+
+    thread_local std::uint64_t rng = std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1;
+    return steal_task(rng, nullptr);
+}
+
+void
+hvn::executor::run(task_node* task) noexcept {
+    _queued.fetch_sub(1, std::memory_order_relaxed);
+    {
+        trace_scope scope(trace_event::job_run, trace_id(task));
+        task->run(task);
+    }
+    _tasks.deallocate(task);
+    if (_unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        _unfinished.notify_all();
+    }
+}
+
+bool
+hvn::executor::try_run_one() {
+    auto self = is_worker() ? _workers[this_worker.idx].get() : nullptr;
+    auto task = find_task(self);
+    if (task == nullptr) return false;
+    run(task);
+    return true;
+}
+
+void
+hvn::executor::wait_idle() {
+    precondition()("a worker waiting for itself would never finish"_msg, [this] { return !is_worker(); });
+
+    for (auto left = _unfinished.load(std::memory_order_acquire);
+         left != 0;
+         left = _unfinished.load(std::memory_order_acquire)) {
+        if (try_run_one()) continue;
+        // what is left is running on other threads
+        _unfinished.wait(left, std::memory_order_acquire);
+    }
+}
+
+void
+hvn::executor::work(std::size_t idx) {
+    this_worker = {this, idx};
+    auto self = _workers[idx].get();
+
+    for (;;) {
+        if (auto task = find_task(self)) {
+            run(task);
+            continue;
+        }
+        if (_queued.load(std::memory_order_relaxed) > 0) {
+            // queued somewhere, but we lost the race for it, or the injection
+            // queue was busy
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock lck(_sleep_mx);
+        _sleepers.fetch_add(1, std::memory_order_seq_cst);
+        _wake.wait(lck, [this] {
+            return _stopping || _queued.load(std::memory_order_seq_cst) > 0;
+        });
+        _sleepers.fetch_sub(1, std::memory_order_relaxed);
+        if (_stopping && _queued.load(std::memory_order_relaxed) == 0) return;
+    }
+}
@@ -0,0 +1,172 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-26.
+ *
+ * src/haven/exec/executor --
+ *   A work-stealing executor for CPU-heavy work following I/O completions.
+ *   Every worker thread has its own work_deque: work posted by a worker goes
+ *   to its own deque, work posted from elsewhere to a shared injection queue.
+ *   Idle workers steal from the deques of randomly chosen other workers.
+ *   Threads that are not workers, like the ones waiting in the harbor, can
+ *   lend a hand by running posted work with try_run_one.
+ *   Tasks are allocated from a hvn::pool, small callables are stored inline
+ *   in them.
+ */
+#ifndef LIBHAVEN_EXECUTOR_HXX
+#define LIBHAVEN_EXECUTOR_HXX
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <haven/exec/work-deque.hxx>
+#include <haven/mem/page-allocator.hxx>
+#include <haven/mem/pool.hxx>
+#include <haven/mem/slot-layout.hxx>
+
+namespace hvn {
+    struct executor {
+        // the number of workers started by default
+        [[nodiscard]] static std::size_t
+        default_concurrency() noexcept;
+
+        explicit executor(std::size_t workers = default_concurrency());
+
+        executor(const executor&) = delete;
+        executor&
+        operator=(const executor&) = delete;
+
+        // runs all work posted before, then stops the workers
+        ~executor() noexcept;
+
+        // schedules fn to be run on one of the workers
+        // fn must not throw; if fn cannot be stored or scheduled, the
+        // exception is propagated and nothing is run
+        template<class Fn>
+        void
+        post(Fn&& fn) {
+            using fn_type = std::decay_t<Fn>;
+            auto task = _tasks.allocate();
+            try {
+                if constexpr (fits_inline<fn_type>) {
+                    ::new (static_cast<void*>(task->storage)) fn_type(std::forward<Fn>(fn));
+                    task->run = [](task_node* self) noexcept {
+                        auto fn = std::launder(reinterpret_cast<fn_type*>(self->storage));
+                        (*fn)();
+                        std::destroy_at(fn);
+                    };
+                }
+                else {
+                    ::new (static_cast<void*>(task->storage)) fn_type*(new fn_type(std::forward<Fn>(fn)));
+                    task->run = [](task_node* self) noexcept {
+                        std::unique_ptr<fn_type> fn(*std::launder(reinterpret_cast<fn_type**>(self->storage)));
+                        (*fn)();
+                    };
+                }
+            } catch (...) {
+                _tasks.deallocate(task);
+                throw;
+            }
+
+            try {
+                schedule(task);
+            } catch (...) {
+                if constexpr (fits_inline<fn_type>) {
+                    std::destroy_at(std::launder(reinterpret_cast<fn_type*>(task->storage)));
+                }
+                else {
+                    delete *std::launder(reinterpret_cast<fn_type**>(task->storage));
+                }
+                _tasks.deallocate(task);
+                throw;
+            }
+        }
+
+        // runs one posted task on the calling thread, if there is any
+        // returns whether a task was run
+        bool
+        try_run_one();
+
+        // blocks until every posted task has finished, helping meanwhile
+        // must not be called from a worker
+        void
+        wait_idle();
+
+        [[nodiscard]] std::size_t
+        worker_count() const noexcept { return _workers.size(); }
+
+        // a snapshot of the number of tasks posted, but not yet taken by any
+        // thread
+        [[nodiscard]] std::size_t
+        queued() const noexcept { return _queued.load(std::memory_order_relaxed); }
+
+        // whether the calling thread is one of this executor's workers
+        [[nodiscard]] bool
+        is_worker() const noexcept;
+
+    private:
+        constexpr const static auto inline_size = std::size_t{48};
+
+        struct task_node {
+            void (*run)(task_node*) noexcept;
+            alignas(std::max_align_t) std::byte storage[inline_size];
+        };
+
+        template<class Fn>
+        constexpr const static bool fits_inline = sizeof(Fn) <= inline_size
+                                                  && alignof(Fn) <= alignof(std::max_align_t);
+
+        struct worker {
+            work_deque<task_node> deque{};
+            std::uint64_t rng;
+        };
+
+        // on exception the task is not queued, and stays with the caller
+        void
+        schedule(task_node* task);
+
+        task_node*
+        find_task(worker* self);
+
+        task_node*
+        steal_task(std::uint64_t& rng, const worker* self);
+
+        void
+        run(task_node* task) noexcept;
+
+        void
+        work(std::size_t idx);
+
+        std::vector<std::unique_ptr<worker>> _workers;
+        pool<task_node, page_allocator, cache_line_layout> _tasks{};
+
+        std::mutex _inject_mx;
+        std::deque<task_node*> _injected{};
+
+        // tasks posted, but not yet taken by any thread
+        std::atomic<std::size_t> _queued{};
+        // tasks posted, but not yet finished
+        std::atomic<std::size_t> _unfinished{};
+
+        std::mutex _sleep_mx;
+        std::condition_variable _wake;
+        std::atomic<std::size_t> _sleepers{};
+        bool _stopping = false; // guarded by _sleep_mx
+
+        std::vector<std::jthread> _threads{};
+    };
+}
+
+#endif
@@ -0,0 +1,13 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-26.
+ *
+ * src/haven/exec/work-deque --
+ *   Source file for the work-stealing deque.
+ *   Used to ensure clean inclusion.
+ */
+
+#include "work-deque.hxx"
@@ -0,0 +1,155 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-26.
+ *
+ * src/haven/exec/work-deque --
+ *   A Chase-Lev work-stealing deque of pointers.
+ *   The owner thread pushes and pops at the bottom without locking, any other
+ *   thread may steal from the top. The ring grows when full; outgrown rings
+ *   are kept until the deque is destroyed, as thieves may still be reading
+ *   them.
+ *   The memory orderings follow Lê et al., "Correct and Efficient
+ *   Work-Stealing for Weak Memory Models" (PPoPP '13).
+ */
+#ifndef LIBHAVEN_WORK_DEQUE_HXX
+#define LIBHAVEN_WORK_DEQUE_HXX
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <haven/common/check_conditions.hxx>
+
+namespace hvn {
+    template<class T>
+    struct work_deque {
+        constexpr const static auto default_capacity = std::size_t{256};
+
+        explicit work_deque(std::size_t capacity = default_capacity) {
+            precondition()("capacity is a power of two"_msg,
+                           [](auto capacity) { return std::has_single_bit(capacity); },
+                           capacity);
+            _rings.push_back(std::make_unique<ring>(capacity));
+            _ring.store(_rings.back().get(), std::memory_order_relaxed);
+        }
+
+        work_deque(const work_deque&) = delete;
+        work_deque&
+        operator=(const work_deque&) = delete;
+
+        // owner only
+        void
+        push(T* item) {
+            auto bottom = _bottom.load(std::memory_order_relaxed);
+            auto top = _top.load(std::memory_order_acquire);
+            auto buf = _ring.load(std::memory_order_relaxed);
+            if (bottom - top > static_cast<std::int64_t>(buf->capacity) - 1) {
+                buf = grow(buf, top, bottom);
+            }
+            buf->put(bottom, item);
+            // the fence orders the item before every later store to _bottom,
+            // pop's too; the store is release as well, because thread
+            // sanitizers do not model fences
+            std::atomic_thread_fence(std::memory_order_release);
+            _bottom.store(bottom + 1, std::memory_order_release);
+        }
+
+        // owner only, takes the most recently pushed item
+        [[nodiscard]] T*
+        pop() noexcept {
+            auto bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            auto buf = _ring.load(std::memory_order_relaxed);
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto top = _top.load(std::memory_order_relaxed);
+
+            if (top > bottom) {
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            auto item = buf->get(bottom);
+            if (top == bottom) {
+                // the last item, race the thieves for it
+                if (!_top.compare_exchange_strong(top,
+                                                  top + 1,
+                                                  std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        // any thread, takes the least recently pushed item
+        // returns null if the deque is empty or another thread won the item
+        [[nodiscard]] T*
+        steal() noexcept {
+            auto top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto bottom = _bottom.load(std::memory_order_acquire);
+            if (top >= bottom) return nullptr;
+
+            auto item = _ring.load(std::memory_order_acquire)->get(top);
+            if (!_top.compare_exchange_strong(top,
+                                              top + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return item;
+        }
+
+        // a snapshot, only exact if no other thread uses the deque
+        [[nodiscard]] bool
+        empty() const noexcept {
+            return _top.load(std::memory_order_relaxed) >= _bottom.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct ring {
+            explicit ring(std::size_t capacity)
+                 : capacity(capacity),
+                   items(std::make_unique<std::atomic<T*>[]>(capacity)) { }
+
+            T*
+            get(std::int64_t idx) const noexcept {
+                return items[static_cast<std::size_t>(idx) & (capacity - 1)].load(std::memory_order_relaxed);
+            }
+
+            void
+            put(std::int64_t idx, T* item) noexcept {
+                items[static_cast<std::size_t>(idx) & (capacity - 1)].store(item, std::memory_order_relaxed);
+            }
+
+            std::size_t capacity;
+            std::unique_ptr<std::atomic<T*>[]> items;
+        };
+
+        ring*
+        grow(ring* old, std::int64_t top, std::int64_t bottom) {
+            auto bigger = std::make_unique<ring>(old->capacity * 2);
+            for (auto i = top; i < bottom; ++i) {
+                bigger->put(i, old->get(i));
+            }
+            _rings.push_back(std::move(bigger));
+            auto ret = _rings.back().get();
+            _ring.store(ret, std::memory_order_release);
+            return ret;
+        }
+
+        alignas(64) std::atomic<std::int64_t> _top{};
+        alignas(64) std::atomic<std::int64_t> _bottom{};
+        std::atomic<ring*> _ring;
+        std::vector<std::unique_ptr<ring>> _rings; // owner only
+    };
+}
+
+#endif
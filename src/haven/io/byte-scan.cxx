@@ -0,0 +1,13 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-29.
+ *
+ * src/haven/io/byte-scan --
+ *   Source file for the byte scanner policies.
+ *   Used to ensure clean inclusion.
+ */
+
+#include "byte-scan.hxx"
@@ -0,0 +1,77 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-29.
+ *
+ * src/haven/io/byte-scan --
+ *   Scanner policies finding the first occurrence of a byte in a block.
+ *   The SIMD scanner compares whole batches of bytes at once using xsimd, the
+ *   scalar one defers to memchr.
+ */
+#ifndef LIBHAVEN_BYTE_SCAN_HXX
+#define LIBHAVEN_BYTE_SCAN_HXX
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include <xsimd/xsimd.hpp>
+
+namespace hvn {
+    // a scanner returns the index of the first occurrence of the value in the
+    // data, or the size of the data if it does not occur
+    template<class S>
+    concept byte_scanner =
+           requires(std::span<const std::byte> data, std::byte value) {
+               { S::find(data, value) } -> std::same_as<std::size_t>;
+           };
+
+    struct memchr_scanner {
+        [[nodiscard]] static std::size_t
+        find(std::span<const std::byte> data, std::byte value) noexcept {
+            if (data.empty()) return 0;
+            auto found = std::memchr(data.data(), static_cast<int>(value), data.size());
+            if (found == nullptr) return data.size();
+            return static_cast<std::size_t>(static_cast<const std::byte*>(found) - data.data());
+        }
+    };
+
+    struct simd_scanner {
+        [[nodiscard]] static std::size_t
+        find(std::span<const std::byte> data, std::byte value) noexcept {
+            namespace xs = xsimd;
+            using batch_type = xs::batch<std::uint8_t>;
+            auto target = static_cast<std::uint8_t>(value);
+            auto needle = batch_type ::broadcast(target);
+            auto bytes = reinterpret_cast<const std::uint8_t*>(data.data());
+
+            // delimiters are sparse in most blocks, so four batches are compared
+            // per step, and the exact position is only looked for on a hit
+            constexpr const auto simd_size = batch_type ::size;
+            constexpr const auto step_size = 4 * simd_size;
+            auto size = data.size();
+            auto vectorized_size = size - size % step_size;
+
+            for (std::size_t i = 0; i < vectorized_size; i += step_size) {
+                auto bools = (batch_type ::load_unaligned(bytes + i) == needle)
+                             | (batch_type ::load_unaligned(bytes + i + simd_size) == needle)
+                             | (batch_type ::load_unaligned(bytes + i + 2 * simd_size) == needle)
+                             | (batch_type ::load_unaligned(bytes + i + 3 * simd_size) == needle);
+                if (xs::any(bools)) {
+                    return static_cast<std::size_t>(std::ranges::find(bytes + i, bytes + i + step_size, target) - bytes);
+                }
+            }
+            return static_cast<std::size_t>(std::ranges::find(bytes + vectorized_size, bytes + size, target) - bytes);
+        }
+    };
+
+    static_assert(byte_scanner<memchr_scanner>, "hvn::memchr_scanner needs to be a hvn::byte_scanner");
+    static_assert(byte_scanner<simd_scanner>, "hvn::simd_scanner needs to be a hvn::byte_scanner");
+}
+
+#endif
@@ -0,0 +1,92 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-30.
+ *
+ * src/haven/io/file-dock --
+ *   Platform independent part of the hvn::file_dock: splitting transfers
+ *   into their direct and buffered parts.
+ */
+
+#include "file-dock.hxx"
+
+#include <algorithm>
+#include <limits>
+#include <system_error>
+#include <tuple>
+
+#include "../common/trace.hxx"
+
+namespace {
+    std::uint32_t
+    trace_arg(std::size_t bytes) noexcept {
+        return static_cast<std::uint32_t>(std::min<std::size_t>(bytes, std::numeric_limits<std::uint32_t>::max()));
+    }
+}
+
+std::size_t
+hvn::file_dock::direct_part(const std::byte* data, std::size_t size, std::uint64_t offset) const noexcept {
+    if (!is_direct()) return 0;
+    auto align = alignment();
+    if (reinterpret_cast<std::uintptr_t>(data) % align != 0 || offset % align != 0) return 0;
+    return size - size % align;
+}
+
+void
+hvn::file_dock::direct_refused() {
+    // once direct transfers have worked, the file system does support them
+    if (_direct_proven.load(std::memory_order_relaxed)) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "direct transfer");
+    }
+    _direct.store(false, std::memory_order_relaxed);
+}
+
+std::size_t
+hvn::file_dock::read(std::span<std::byte> block, std::uint64_t offset) {
+    trace(trace_event::io_submit, trace_phase::instant, trace_arg(block.size()));
+    std::size_t done = 0;
+
+    auto head = direct_part(block.data(), block.size(), offset);
+    if (head > 0) {
+        auto res = read_at(_file, block.first(head), offset);
+        if (res) {
+            done = *res;
+            _direct_proven.store(true, std::memory_order_relaxed);
+        }
+        else {
+            direct_refused();
+        }
+    }
+    // the unaligned tail, or what a short direct read left, goes buffered
+    if (done < block.size()) {
+        done += *read_at(_buffered, block.subspan(done), offset + done);
+    }
+
+    trace(trace_event::io_complete, trace_phase::instant, trace_arg(done));
+    return done;
+}
+
+void
+hvn::file_dock::write(std::span<const std::byte> block, std::uint64_t offset) {
+    trace(trace_event::io_submit, trace_phase::instant, trace_arg(block.size()));
+    std::size_t done = 0;
+
+    auto head = direct_part(block.data(), block.size(), offset);
+    if (head > 0) {
+        auto res = write_at(_file, block.first(head), offset);
+        if (res) {
+            done = *res;
+            _direct_proven.store(true, std::memory_order_relaxed);
+        }
+        else {
+            direct_refused();
+        }
+    }
+    if (done < block.size()) {
+        std::ignore = write_at(_buffered, block.subspan(done), offset + done);
+    }
+
+    trace(trace_event::io_complete, trace_phase::instant, trace_arg(block.size()));
+}
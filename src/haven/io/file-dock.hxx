@@ -0,0 +1,108 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-30.
+ *
+ * src/haven/io/file-dock --
+ *   A dock reading and writing a file in blocks at given offsets.
+ *   In direct mode the transfers bypass the page cache of the operating
+ *   system, so bulk ingestion does not evict hot data. This requires the
+ *   memory, the offset and the length of transfers to be aligned to the
+ *   block size, which blocks from the page_allocator are. Whatever is not
+ *   aligned, like the tail of a file, is transferred through a second,
+ *   buffered handle. If the file system rejects direct I/O, the dock falls
+ *   back to only using the buffered handle.
+ */
+#ifndef LIBHAVEN_FILE_DOCK_HXX
+#define LIBHAVEN_FILE_DOCK_HXX
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+#include <haven/mem/page-allocator.hxx>
+
+namespace hvn {
+    enum class file_access {
+        read,
+        write,
+        read_write,
+    };
+
+    enum class file_caching {
+        buffered,
+        direct,
+    };
+
+    struct file_dock {
+        // opens the file, creating it if it is to be written
+        // throws std::system_error if the file cannot be opened
+        file_dock(const std::filesystem::path& path,
+                  file_access access,
+                  file_caching caching = file_caching::buffered);
+
+        file_dock(const file_dock&) = delete;
+        file_dock&
+        operator=(const file_dock&) = delete;
+
+        ~file_dock() noexcept;
+
+        // whether aligned transfers bypass the page cache
+        // may turn false if the file system rejects the first direct transfer
+        [[nodiscard]] bool
+        is_direct() const noexcept { return _direct.load(std::memory_order_relaxed); }
+
+        // the alignment of memory, offsets and lengths of direct transfers
+        [[nodiscard]] static std::size_t
+        alignment() { return page_allocator::page_size(); }
+
+        // reads into the block from the offset in the file
+        // returns the number of bytes read, which is less than the size of
+        // the block only at the end of the file
+        std::size_t
+        read(std::span<std::byte> block, std::uint64_t offset);
+
+        // writes the whole block to the offset in the file
+        void
+        write(std::span<const std::byte> block, std::uint64_t offset);
+
+        [[nodiscard]] std::uint64_t
+        size() const;
+
+        // waits until everything written is on the storage device
+        void
+        sync();
+
+    private:
+        // the length of the aligned head of a transfer that may go direct
+        [[nodiscard]] std::size_t
+        direct_part(const std::byte* data, std::size_t size, std::uint64_t offset) const noexcept;
+
+        // switches to buffered transfers if no direct one has succeeded yet,
+        // otherwise the refusal is an error and std::system_error is thrown
+        void
+        direct_refused();
+
+        // the platform dependent transfers of the whole span, stopping early
+        // at the end of the file; on the direct handle they stop after the
+        // first short transfer, as the rest would not be aligned
+        // returns std::nullopt if the file system refused a direct transfer
+        // throws std::system_error on any other error
+        std::optional<std::size_t>
+        read_at(std::intptr_t file, std::span<std::byte> block, std::uint64_t offset);
+        std::optional<std::size_t>
+        write_at(std::intptr_t file, std::span<const std::byte> block, std::uint64_t offset);
+
+        std::intptr_t _file;        // the direct handle, or the buffered one
+        std::intptr_t _buffered;
+        std::atomic<bool> _direct{};
+        std::atomic<bool> _direct_proven{}; // a direct transfer has succeeded
+    };
+}
+
+#endif
@@ -0,0 +1,138 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-30.
+ *
+ * src/haven/io/file-dock.unix --
+ *   POSIX implementation of the hvn::file_dock using pread(2) and pwrite(2).
+ *   Direct I/O is requested with O_DIRECT where it exists, or with the
+ *   F_NOCACHE fcntl(2) on Apple platforms.
+ */
+
+#include "file-dock.hxx"
+
+#include <cerrno>
+#include <system_error>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    int
+    open_flags(hvn::file_access access) noexcept {
+        switch (access) {
+        case hvn::file_access::read: return O_RDONLY;
+        case hvn::file_access::write: return O_WRONLY | O_CREAT;
+        case hvn::file_access::read_write: return O_RDWR | O_CREAT;
+        }
+        return O_RDONLY;
+    }
+
+    // opens a handle bypassing the page cache, or returns -1 if the file
+    // system does not support it
+    int
+    open_direct(const std::filesystem::path& path, int flags) {
+#if defined(O_DIRECT)
+        auto fd = open(path.c_str(), flags | O_DIRECT | O_CLOEXEC, 0600);
+        if (fd < 0 && errno != EINVAL) throw std::system_error(errno, std::system_category(), "open");
+        return fd;
+#elif defined(F_NOCACHE)
+        auto fd = open(path.c_str(), flags | O_CLOEXEC, 0600);
+        if (fd < 0) throw std::system_error(errno, std::system_category(), "open");
+        if (fcntl(fd, F_NOCACHE, 1) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+#else
+        std::ignore = path;
+        std::ignore = flags;
+        return -1;
+#endif
+    }
+}
+
+hvn::file_dock::file_dock(const std::filesystem::path& path,
+                          file_access access,
+                          file_caching caching) {
+    auto flags = open_flags(access);
+    auto fd = open(path.c_str(), flags | O_CLOEXEC, 0600);
+    if (fd < 0) throw std::system_error(errno, std::system_category(), "open");
+    _buffered = _file = fd;
+
+    if (caching == file_caching::direct) {
+        int direct_fd;
+        try {
+            direct_fd = open_direct(path, flags & ~O_CREAT);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        if (direct_fd >= 0) {
+            _file = direct_fd;
+            _direct.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+hvn::file_dock::~file_dock() noexcept {
+    if (_file != _buffered) close(static_cast<int>(_file));
+    close(static_cast<int>(_buffered));
+}
+
+std::optional<std::size_t>
+hvn::file_dock::read_at(std::intptr_t file, std::span<std::byte> block, std::uint64_t offset) {
+    std::size_t done = 0;
+    while (done < block.size()) {
+        auto res = pread(static_cast<int>(file),
+                         block.data() + done,
+                         block.size() - done,
+                         static_cast<off_t>(offset + done));
+        if (res == 0) break;
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL && file != _buffered && done == 0) return std::nullopt;
+            throw std::system_error(errno, std::system_category(), "pread");
+        }
+        done += static_cast<std::size_t>(res);
+        // going on after a short direct transfer would be unaligned
+        if (file != _buffered) break;
+    }
+    return done;
+}
+
+std::optional<std::size_t>
+hvn::file_dock::write_at(std::intptr_t file, std::span<const std::byte> block, std::uint64_t offset) {
+    std::size_t done = 0;
+    while (done < block.size()) {
+        auto res = pwrite(static_cast<int>(file),
+                          block.data() + done,
+                          block.size() - done,
+                          static_cast<off_t>(offset + done));
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL && file != _buffered && done == 0) return std::nullopt;
+            throw std::system_error(errno, std::system_category(), "pwrite");
+        }
+        done += static_cast<std::size_t>(res);
+        // going on after a short direct transfer would be unaligned
+        if (file != _buffered) break;
+    }
+    return done;
+}
+
+std::uint64_t
+hvn::file_dock::size() const {
+    struct stat st {};
+    if (fstat(static_cast<int>(_buffered), &st) != 0) throw std::system_error(errno, std::system_category(), "fstat");
+    return static_cast<std::uint64_t>(st.st_size);
+}
+
+void
+hvn::file_dock::sync() {
+    if (fsync(static_cast<int>(_buffered)) != 0) throw std::system_error(errno, std::system_category(), "fsync");
+}
@@ -0,0 +1,157 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-30.
+ *
+ * src/haven/io/file-dock.win --
+ *   Windows implementation of the hvn::file_dock using positioned
+ *   ReadFile and WriteFile calls.
+ *   Direct I/O is requested with FILE_FLAG_NO_BUFFERING.
+ */
+
+#include "file-dock.hxx"
+
+#include <system_error>
+
+#ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#  define NOMINMAX
+#endif
+#include <windows.h>
+
+namespace {
+    HANDLE
+    as_handle(std::intptr_t value) noexcept {
+        return reinterpret_cast<HANDLE>(value);
+    }
+
+    [[noreturn]] void
+    throw_last_error(const char* what) {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+    }
+
+    DWORD
+    desired_access(hvn::file_access access) noexcept {
+        switch (access) {
+        case hvn::file_access::read: return GENERIC_READ;
+        case hvn::file_access::write: return GENERIC_WRITE;
+        case hvn::file_access::read_write: return GENERIC_READ | GENERIC_WRITE;
+        }
+        return GENERIC_READ;
+    }
+
+    OVERLAPPED
+    at_offset(std::uint64_t offset) noexcept {
+        OVERLAPPED ret{};
+        ret.Offset = static_cast<DWORD>(offset);
+        ret.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        return ret;
+    }
+
+    DWORD
+    chunk_of(std::size_t size) noexcept {
+        // the largest aligned length fitting a DWORD, to keep direct
+        // transfers aligned
+        constexpr const auto max_chunk = std::size_t{1} << 30;
+        return static_cast<DWORD>(size < max_chunk ? size : max_chunk);
+    }
+}
+
+hvn::file_dock::file_dock(const std::filesystem::path& path,
+                          file_access access,
+                          file_caching caching) {
+    auto rights = desired_access(access);
+    auto disposition = access == file_access::read ? OPEN_EXISTING : OPEN_ALWAYS;
+    HANDLE file = CreateFileW(path.c_str(),
+                              rights,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr,
+                              disposition,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw_last_error("CreateFileW");
+    _buffered = _file = reinterpret_cast<std::intptr_t>(file);
+
+    if (caching == file_caching::direct) {
+        HANDLE direct = CreateFileW(path.c_str(),
+                                    rights,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                    nullptr,
+                                    OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING,
+                                    nullptr);
+        if (direct == INVALID_HANDLE_VALUE) {
+            // the file system does not support unbuffered I/O, stay buffered
+            auto err = GetLastError();
+            if (err != ERROR_INVALID_PARAMETER) {
+                CloseHandle(file);
+                throw std::system_error(static_cast<int>(err), std::system_category(), "CreateFileW");
+            }
+        }
+        else {
+            _file = reinterpret_cast<std::intptr_t>(direct);
+            _direct.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+hvn::file_dock::~file_dock() noexcept {
+    if (_file != _buffered) CloseHandle(as_handle(_file));
+    CloseHandle(as_handle(_buffered));
+}
+
+std::optional<std::size_t>
+hvn::file_dock::read_at(std::intptr_t file, std::span<std::byte> block, std::uint64_t offset) {
+    std::size_t done = 0;
+    while (done < block.size()) {
+        auto chunk = chunk_of(block.size() - done);
+        auto overlapped = at_offset(offset + done);
+        DWORD read = 0;
+        if (!ReadFile(as_handle(file), block.data() + done, chunk, &read, &overlapped)) {
+            auto err = GetLastError();
+            if (err == ERROR_HANDLE_EOF) break;
+            if (err == ERROR_INVALID_PARAMETER && file != _buffered && done == 0) return std::nullopt;
+            throw std::system_error(static_cast<int>(err), std::system_category(), "ReadFile");
+        }
+        if (read == 0) break;
+        done += read;
+        // going on after a short direct transfer would be unaligned
+        if (file != _buffered && read < chunk) break;
+    }
+    return done;
+}
+
+std::optional<std::size_t>
+hvn::file_dock::write_at(std::intptr_t file, std::span<const std::byte> block, std::uint64_t offset) {
+    std::size_t done = 0;
+    while (done < block.size()) {
+        auto chunk = chunk_of(block.size() - done);
+        auto overlapped = at_offset(offset + done);
+        DWORD written = 0;
+        if (!WriteFile(as_handle(file), block.data() + done, chunk, &written, &overlapped)) {
+            auto err = GetLastError();
+            if (err == ERROR_INVALID_PARAMETER && file != _buffered && done == 0) return std::nullopt;
+            throw std::system_error(static_cast<int>(err), std::system_category(), "WriteFile");
+        }
+        done += written;
+        // going on after a short direct transfer would be unaligned
+        if (file != _buffered && written < chunk) break;
+    }
+    return done;
+}
+
+std::uint64_t
+hvn::file_dock::size() const {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(as_handle(_buffered), &size)) throw_last_error("GetFileSizeEx");
+    return static_cast<std::uint64_t>(size.QuadPart);
+}
+
+void
+hvn::file_dock::sync() {
+    if (!FlushFileBuffers(as_handle(_buffered))) throw_last_error("FlushFileBuffers");
+}
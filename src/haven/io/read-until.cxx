@@ -0,0 +1,51 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-29.
+ *
+ * src/haven/io/read-until --
+ *   Source file for the hvn::delimiter_framer class, and the implementation
+ *   of the blocks read_until reads into.
+ */
+
+#include "read-until.hxx"
+
+#include "../common/check_conditions.hxx"
+
+hvn::dock_block::~dock_block() noexcept {
+    if (_page) _cache->give_back(*_page);
+}
+
+hvn::dock_block_cache::dock_block_cache(std::size_t block_size)
+     : _block_size(block_size) {
+    precondition()([](auto block_size,
+                      auto page_size) { return block_size > 0 && block_size % page_size == 0; },
+                   block_size,
+                   _allocator.page_size());
+}
+
+hvn::dock_block_cache::~dock_block_cache() noexcept {
+    for (auto page : _free) _allocator.deallocate(page);
+}
+
+hvn::dock_block
+hvn::dock_block_cache::acquire() {
+    // reserved up front, so giving the block back cannot fail
+    _free.reserve(_allocated + 1);
+    if (_free.empty()) {
+        auto page = _allocator.allocate(_block_size);
+        ++_allocated;
+        return {this, page};
+    }
+
+    auto page = _free.back();
+    _free.pop_back();
+    return {this, page};
+}
+
+void
+hvn::dock_block_cache::give_back(page_allocator::committed_page page) noexcept {
+    _free.push_back(page);
+}
@@ -0,0 +1,365 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-29.
+ *
+ * src/haven/io/read-until --
+ *   The framing part of the read_until contract: splits the stream of read
+ *   blocks into the frames between delimiters, like lines or NUL-separated
+ *   records.
+ *   Blocks are scanned for the first byte of the delimiter using a byte
+ *   scanner. Delimiters straddling two or more blocks are found by carrying
+ *   the length of the partially matched delimiter to the next block.
+ *   Frames are not copied: they are delivered as views into the read blocks,
+ *   which the framer retains while a frame spanning them is incomplete.
+ *   read_until drives a framer over a file dock, reading into blocks of the
+ *   page_allocator, which are reused once no frame views them.
+ */
+#ifndef LIBHAVEN_READ_UNTIL_HXX
+#define LIBHAVEN_READ_UNTIL_HXX
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <haven/common/check_conditions.hxx>
+#include <haven/io/byte-scan.hxx>
+#include <haven/io/file-dock.hxx>
+#include <haven/mem/page-allocator.hxx>
+
+namespace hvn {
+    // The bytes between two delimiters, without the delimiter itself, viewed
+    // in the read blocks holding them: in a single piece if the frame lies in
+    // one block, otherwise in one piece per block.
+    // The views are only valid while the frame is being handled, to use the
+    // bytes later, keep the blocks or copy the bytes.
+    template<class Block>
+    struct read_frame {
+        std::span<const std::span<const std::byte>> pieces;
+        std::span<const Block> blocks;
+
+        [[nodiscard]] std::size_t
+        size() const noexcept {
+            std::size_t ret = 0;
+            for (auto piece : pieces) ret += piece.size();
+            return ret;
+        }
+
+        [[nodiscard]] bool
+        empty() const noexcept { return size() == 0; }
+
+        [[nodiscard]] bool
+        contiguous() const noexcept { return pieces.size() <= 1; }
+
+        // the bytes of a frame lying in one block
+        [[nodiscard]] std::span<const std::byte>
+        bytes() const noexcept {
+            precondition()("only contiguous frames are a single span"_msg, [this] { return contiguous(); });
+            if (pieces.empty()) return {};
+            return pieces.front();
+        }
+
+        template<std::output_iterator<std::byte> OutIt>
+        OutIt
+        copy_to(OutIt out) const {
+            for (auto piece : pieces) out = std::ranges::copy(piece, out).out;
+            return out;
+        }
+    };
+
+    template<class Block, byte_scanner Scanner = simd_scanner>
+    struct delimiter_framer {
+        using block_type = Block;
+        using frame_type = read_frame<Block>;
+        using scanner_type = Scanner;
+
+        explicit delimiter_framer(std::span<const std::byte> delimiter)
+             : _delimiter(delimiter.begin(), delimiter.end()),
+               _fallback(delimiter.size()) {
+            precondition()("the delimiter is not empty"_msg, [this] { return !_delimiter.empty(); });
+
+            // the usual KMP failure function: the length of the longest proper
+            // prefix of the delimiter also ending at each position
+            for (std::size_t i = 1, len = 0; i < _delimiter.size(); ++i) {
+                while (len > 0 && _delimiter[i] != _delimiter[len]) len = _fallback[len - 1];
+                if (_delimiter[i] == _delimiter[len]) ++len;
+                _fallback[i] = len;
+            }
+        }
+
+        explicit delimiter_framer(std::string_view delimiter)
+             : delimiter_framer(std::as_bytes(std::span(delimiter))) { }
+
+        delimiter_framer(const delimiter_framer&) = delete;
+        delimiter_framer&
+        operator=(const delimiter_framer&) = delete;
+
+        // takes the data read into the block, and calls on_frame with every
+        // frame completed by it; returns the number of frames delivered
+        // the block is kept until no incomplete frame views it
+        template<class Fn>
+            requires std::invocable<Fn&, const frame_type&>
+        std::size_t
+        push(block_type block, std::span<const std::byte> data, Fn&& on_frame) {
+            _blocks.push_back(std::move(block));
+            auto delim_size = _delimiter.size();
+            std::size_t frames = 0;
+            std::size_t start = 0; // of the next frame in data
+            std::size_t pos = 0;   // of the scan in data
+
+            if (_matched > 0) {
+                // the delimiter may end in the first few bytes of this block
+                auto state = _matched;
+                auto limit = std::min(data.size(), delim_size - 1);
+                _matched = 0;
+                for (std::size_t i = 0; i < limit; ++i) {
+                    state = step(state, data[i]);
+                    if (state != delim_size) continue;
+
+                    trim_pending(delim_size - (i + 1));
+                    deliver(std::span<const block_type>(_blocks).first(_blocks.size() - 1), on_frame);
+                    ++frames;
+                    start = pos = i + 1;
+                    break;
+                }
+                if (start == 0 && limit == data.size()) {
+                    // the whole block may still be part of the delimiter
+                    _matched = state;
+                    if (!data.empty()) _pieces.push_back(data);
+                    return frames;
+                }
+            }
+
+            while (pos < data.size()) {
+                auto rest = data.subspan(pos);
+                auto at = pos + scanner_type::find(rest, _delimiter.front());
+                if (at + delim_size > data.size()) break;
+
+                if (!std::ranges::equal(data.subspan(at, delim_size), _delimiter)) {
+                    pos = at + 1;
+                    continue;
+                }
+                auto piece = data.subspan(start, at - start);
+                if (_pieces.empty()) {
+                    frame_type frame{std::span(&piece, piece.empty() ? 0 : 1),
+                                     std::span<const block_type>(&_blocks.back(), 1)};
+                    on_frame(std::as_const(frame));
+                }
+                else {
+                    if (!piece.empty()) _pieces.push_back(piece);
+                    deliver(std::span<const block_type>(_blocks), on_frame);
+                }
+                ++frames;
+                start = pos = at + delim_size;
+            }
+
+            if (start < data.size()) {
+                auto tail = data.subspan(std::max(start, data.size() - std::min(data.size(), delim_size - 1)));
+                for (auto b : tail) _matched = step(_matched, b);
+                _pieces.push_back(data.subspan(start));
+            }
+            if (_pieces.empty()) _blocks.clear();
+            return frames;
+        }
+
+        // to be called at the end of the stream: delivers the bytes after the
+        // last delimiter as the last frame, if there are any
+        template<class Fn>
+            requires std::invocable<Fn&, const frame_type&>
+        bool
+        finish(Fn&& on_frame) {
+            _matched = 0;
+            if (_pieces.empty()) {
+                _blocks.clear();
+                return false;
+            }
+            deliver(std::span<const block_type>(_blocks), on_frame);
+            _blocks.clear();
+            return true;
+        }
+
+        [[nodiscard]] std::span<const std::byte>
+        delimiter() const noexcept { return _delimiter; }
+
+        // the number of bytes read, but not yet delivered in a frame
+        [[nodiscard]] std::size_t
+        pending() const noexcept {
+            std::size_t ret = 0;
+            for (auto piece : _pieces) ret += piece.size();
+            return ret;
+        }
+
+        [[nodiscard]] std::size_t
+        retained() const noexcept { return _blocks.size(); }
+
+    private:
+        // advances the length of the partially matched delimiter by a byte
+        [[nodiscard]] std::size_t
+        step(std::size_t state, std::byte b) const noexcept {
+            while (state > 0 && _delimiter[state] != b) state = _fallback[state - 1];
+            if (_delimiter[state] == b) ++state;
+            return state;
+        }
+
+        // drops the last count bytes of the pending pieces, which turned out
+        // to be the beginning of a delimiter
+        void
+        trim_pending(std::size_t count) noexcept {
+            while (count > 0) {
+                auto& last = _pieces.back();
+                auto dropped = std::min(count, last.size());
+                last = last.first(last.size() - dropped);
+                count -= dropped;
+                if (last.empty()) _pieces.pop_back();
+            }
+        }
+
+        // delivers the pending pieces as a frame, and releases all blocks but
+        // the last one, which may hold the beginning of the next frame
+        template<class Fn>
+        void
+        deliver(std::span<const block_type> blocks, Fn& on_frame) {
+            frame_type frame{std::span<const std::span<const std::byte>>(_pieces), blocks};
+            on_frame(std::as_const(frame));
+            _pieces.clear();
+            _blocks.erase(_blocks.begin(), _blocks.end() - 1);
+        }
+
+        std::vector<std::byte> _delimiter;
+        std::vector<std::size_t> _fallback;
+        std::size_t _matched{};
+        std::vector<std::span<const std::byte>> _pieces{};
+        std::vector<block_type> _blocks{};
+    };
+
+    struct dock_block_cache;
+
+    // A block of pages read into from a dock, given back to its cache on
+    // destruction.
+    struct dock_block {
+        dock_block(dock_block&& other) noexcept
+             : _cache(std::exchange(other._cache, nullptr)),
+               _page(std::exchange(other._page, std::nullopt)) { }
+
+        dock_block&
+        operator=(dock_block&& other) noexcept {
+            dock_block(std::move(other)).swap(*this);
+            return *this;
+        }
+
+        ~dock_block() noexcept;
+
+        [[nodiscard]] std::span<std::byte>
+        bytes() const noexcept {
+            if (!_page) return {};
+            return {_page->base_addr(), _page->size()};
+        }
+
+    private:
+        dock_block(dock_block_cache* cache, page_allocator::committed_page page) noexcept
+             : _cache(cache),
+               _page(page) { }
+
+        void
+        swap(dock_block& other) noexcept {
+            std::swap(_cache, other._cache);
+            std::swap(_page, other._page);
+        }
+
+        dock_block_cache* _cache;
+        std::optional<page_allocator::committed_page> _page;
+
+        friend dock_block_cache;
+    };
+
+    // Keeps the pages of the blocks no longer in use, so reading a file only
+    // allocates as many blocks as frames span at once.
+    struct dock_block_cache {
+        // block_size is a multiple of the page size, keeping the blocks
+        // aligned for direct transfers
+        explicit dock_block_cache(std::size_t block_size);
+
+        dock_block_cache(const dock_block_cache&) = delete;
+        dock_block_cache&
+        operator=(const dock_block_cache&) = delete;
+
+        // every block taken is to be destroyed before the cache
+        ~dock_block_cache() noexcept;
+
+        [[nodiscard]] std::size_t
+        block_size() const noexcept { return _block_size; }
+
+        // the number of blocks ever allocated
+        [[nodiscard]] std::size_t
+        allocated() const noexcept { return _allocated; }
+
+        [[nodiscard]] dock_block
+        acquire();
+
+    private:
+        void
+        give_back(page_allocator::committed_page page) noexcept;
+
+        page_allocator _allocator{};
+        std::size_t _block_size;
+        std::size_t _allocated{};
+        std::vector<page_allocator::committed_page> _free{};
+
+        friend dock_block;
+    };
+
+    constexpr const auto default_read_pages = std::size_t{16};
+
+    // reads the whole file through the dock, calling on_frame with every
+    // frame between delimiters, the bytes after the last one included
+    // returns the number of frames delivered
+    // throws std::system_error if reading the file fails
+    template<class Fn>
+        requires std::invocable<Fn&, const read_frame<dock_block>&>
+    std::size_t
+    read_until(file_dock& dock,
+               std::span<const std::byte> delimiter,
+               Fn&& on_frame,
+               std::size_t block_pages = default_read_pages) {
+        precondition()([](auto block_pages) { return block_pages > 0; }, block_pages);
+
+        // declared first, so the blocks retained by the framer go back to it
+        dock_block_cache cache(block_pages * page_allocator::page_size());
+        delimiter_framer<dock_block> framer(delimiter);
+
+        std::size_t frames = 0;
+        std::uint64_t offset = 0;
+        for (;;) {
+            auto block = cache.acquire();
+            auto read = dock.read(block.bytes(), offset);
+            if (read == 0) break;
+
+            auto data = block.bytes().first(read);
+            offset += read;
+            frames += framer.push(std::move(block), data, on_frame);
+            if (read < cache.block_size()) break;
+        }
+        if (framer.finish(on_frame)) ++frames;
+        return frames;
+    }
+
+    template<class Fn>
+        requires std::invocable<Fn&, const read_frame<dock_block>&>
+    std::size_t
+    read_until(file_dock& dock,
+               std::string_view delimiter,
+               Fn&& on_frame,
+               std::size_t block_pages = default_read_pages) {
+        return read_until(dock, std::as_bytes(std::span(delimiter)), std::forward<Fn>(on_frame), block_pages);
+    }
+}
+
+#endif
@@ -0,0 +1,13 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-25.
+ *
+ * src/haven/mem/arena --
+ *   Source file for the arena and the arena cache.
+ *   Used to ensure clean inclusion.
+ */
+
+#include "arena.hxx"
@@ -0,0 +1,315 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-25.
+ *
+ * src/haven/mem/arena --
+ *   A monotonic arena for the short-lived objects of a single job.
+ *   The arena reserves its whole capacity up front, and commits it in chunks
+ *   as the bump pointer advances. Nothing is freed one by one: resetting the
+ *   arena releases everything at once, optionally giving the chunks above a
+ *   high-water mark back to the allocator.
+ *   Arenas are reused through a per-thread arena_cache.
+ */
+#ifndef LIBHAVEN_ARENA_HXX
+#define LIBHAVEN_ARENA_HXX
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <haven/common/check_conditions.hxx>
+#include <haven/mem/page-allocator.hxx>
+
+namespace hvn {
+    // what happens to the committed chunks above the high-water mark when an
+    // arena is reset
+    enum class arena_trim {
+        keep,     // stay committed, the fastest for a steady load
+        decommit, // returned to the allocator
+        loan,     // loaned to the os, which may take them if it needs memory
+    };
+
+    template<sliceable_allocator Allocator = page_allocator>
+    struct arena : std::pmr::memory_resource {
+        using allocator_type = Allocator;
+
+        constexpr const static auto default_chunk_pages = std::size_t{16};
+
+        // reserves capacity bytes, rounded up to pages, and commits them
+        // chunk_pages pages at a time
+        arena(allocator_type* allocator,
+              std::size_t capacity,
+              std::size_t chunk_pages = default_chunk_pages)
+             : _allocator(allocator),
+               _chunk_size(chunk_pages * _allocator->page_size()),
+               _reserved(_allocator->reserve(round_up(capacity, _allocator->page_size()))) {
+            precondition()([](auto chunk_pages) { return chunk_pages > 0; }, chunk_pages);
+        }
+
+        arena(const arena&) = delete;
+        arena&
+        operator=(const arena&) = delete;
+
+        ~arena() noexcept override {
+            _allocator->deallocate(_reserved);
+        }
+
+        [[nodiscard]] std::size_t
+        capacity() const noexcept { return _reserved.size(); }
+
+        [[nodiscard]] std::size_t
+        used() const noexcept { return _top; }
+
+        [[nodiscard]] std::size_t
+        committed() const noexcept { return _committed_size; }
+
+        // throws std::bad_alloc if the reservation is exhausted
+        // named apart from memory_resource::allocate, which it would hide
+        [[nodiscard]] void*
+        allocate_bytes(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+            precondition()("alignment is a power of two, at most the page size"_msg,
+                           [](auto align, auto page_size) { return std::has_single_bit(align) && align <= page_size; },
+                           align,
+                           _allocator->page_size());
+
+            auto start = round_up(_top, align);
+            if (start > capacity() || size > capacity() - start) throw std::bad_alloc{};
+
+            auto end = start + size;
+            if (end > _committed_size) grow(end);
+            _top = end;
+            return base_addr() + start;
+        }
+
+        template<class T, class... Args>
+        [[nodiscard]] T*
+        create(Args&&... args) {
+            auto mem = allocate_bytes(sizeof(T), alignof(T));
+            return std::construct_at(static_cast<T*>(mem), std::forward<Args>(args)...);
+        }
+
+        // frees everything allocated in O(1), without running destructors
+        // with a trim mode other than keep, chunks entirely above the first
+        // retain bytes are decommitted or loaned
+        void
+        reset(arena_trim trim = arena_trim::keep, std::size_t retain = 0) {
+            _top = 0;
+            if (trim == arena_trim::keep) return;
+
+            while (!_committed.empty()) {
+                auto chunk = _committed.back();
+                auto offset = static_cast<std::size_t>(chunk.base_addr() - base_addr());
+                if (offset < retain) break;
+
+                _committed.pop_back();
+                _committed_size = offset;
+                if (trim == arena_trim::decommit) {
+                    std::ignore = _allocator->decommit(chunk);
+                    continue;
+                }
+
+                auto loaned = _allocator->loan(chunk);
+                if (auto refused = std::get_if<typename allocator_type::committed_page>(&loaned)) {
+                    // the rest would not be loaned either
+                    _committed.push_back(*refused);
+                    _committed_size = offset + refused->size();
+                    break;
+                }
+                _loaned.push_back(std::get<typename allocator_type::loaned_page>(loaned));
+            }
+        }
+
+    private:
+        static constexpr std::size_t
+        round_up(std::size_t value, std::size_t multiple) noexcept {
+            return (value + multiple - 1) / multiple * multiple;
+        }
+
+        [[nodiscard]] std::byte*
+        base_addr() const noexcept {
+            return static_cast<std::byte*>(_reserved.base_addr());
+        }
+
+        // commits chunks until the first end bytes are committed
+        // chunks loaned at the last reset are taken back before new ones are
+        // committed
+        void
+        grow(std::size_t end) {
+            while (_committed_size < end) {
+                auto next = base_addr() + _committed_size;
+                if (!_loaned.empty() && static_cast<std::byte*>(_loaned.back().base_addr()) == next) {
+                    _committed.push_back(_allocator->commit(_loaned.back()));
+                    _loaned.pop_back();
+                }
+                else {
+                    auto size = std::min(_chunk_size, capacity() - _committed_size);
+                    _committed.push_back(_allocator->commit(_allocator->slice(_reserved, _committed_size, size)));
+                }
+                _committed_size += _committed.back().size();
+            }
+        }
+
+        void*
+        do_allocate(std::size_t bytes, std::size_t alignment) override {
+            return allocate_bytes(bytes, alignment);
+        }
+
+        void
+        do_deallocate(void*, std::size_t, std::size_t) override {
+            // monotonic: memory is only released by reset
+        }
+
+        [[nodiscard]] bool
+        do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+
+        allocator_type* _allocator;
+        std::size_t _chunk_size;
+        typename allocator_type::allocated_page _reserved;
+        std::size_t _top{};
+        std::size_t _committed_size{};
+        // committed chunks in address order, from the start of the reservation
+        std::vector<typename allocator_type::committed_page> _committed{};
+        // loaned chunks right above the committed ones, the lowest one last
+        std::vector<typename allocator_type::loaned_page> _loaned{};
+    };
+
+    // Keeps the arenas of a thread for reuse between jobs. The cache owns the
+    // allocator the arenas are reserved from, and is only to be used by the
+    // thread that created it; declare it thread_local.
+    template<sliceable_allocator Allocator = page_allocator>
+    struct arena_cache {
+        using allocator_type = Allocator;
+        using arena_type = arena<Allocator>;
+
+        constexpr const static auto default_max_idle = std::size_t{4};
+
+        // an arena borrowed from the cache, reset and returned on destruction
+        struct lease {
+            lease(lease&& other) noexcept
+                 : _cache(std::exchange(other._cache, nullptr)),
+                   _arena(std::move(other._arena)) { }
+
+            lease&
+            operator=(lease&& other) noexcept {
+                lease(std::move(other)).swap(*this);
+                return *this;
+            }
+
+            ~lease() noexcept {
+                if (_arena) _cache->release(std::move(_arena));
+            }
+
+            [[nodiscard]] arena_type&
+            operator*() const noexcept { return *_arena; }
+
+            [[nodiscard]] arena_type*
+            operator->() const noexcept { return _arena.get(); }
+
+            [[nodiscard]] arena_type*
+            get() const noexcept { return _arena.get(); }
+
+        private:
+            lease(arena_cache* cache, std::unique_ptr<arena_type> arena)
+                 : _cache(cache),
+                   _arena(std::move(arena)) { }
+
+            void
+            swap(lease& other) noexcept {
+                std::swap(_cache, other._cache);
+                std::swap(_arena, other._arena);
+            }
+
+            arena_cache* _cache;
+            std::unique_ptr<arena_type> _arena;
+
+            friend arena_cache;
+        };
+
+        // returned arenas are reset with trim, retaining retain bytes
+        // at most max_idle arenas are kept, the rest are destroyed
+        explicit arena_cache(std::size_t arena_capacity,
+                             arena_trim trim = arena_trim::keep,
+                             std::size_t retain = 0,
+                             std::size_t max_idle = default_max_idle)
+            requires(std::default_initializable<allocator_type>)
+             : _arena_capacity(arena_capacity),
+               _trim(trim),
+               _retain(retain),
+               _max_idle(max_idle) { }
+
+        // constructs the cache's allocator from the given arguments
+        template<class... AllocatorArgs>
+        arena_cache(std::size_t arena_capacity,
+                    arena_trim trim,
+                    std::size_t retain,
+                    std::size_t max_idle,
+                    std::in_place_t,
+                    AllocatorArgs&&... args)
+             : _allocator(std::forward<AllocatorArgs>(args)...),
+               _arena_capacity(arena_capacity),
+               _trim(trim),
+               _retain(retain),
+               _max_idle(max_idle) { }
+
+        arena_cache(const arena_cache&) = delete;
+        arena_cache&
+        operator=(const arena_cache&) = delete;
+
+        [[nodiscard]] lease
+        acquire() {
+            precondition()("only the creating thread may use the cache"_msg, [this] { return is_owner(); });
+
+            if (_idle.empty()) {
+                return {this, std::make_unique<arena_type>(&_allocator, _arena_capacity)};
+            }
+            auto ret = std::move(_idle.back());
+            _idle.pop_back();
+            return {this, std::move(ret)};
+        }
+
+        [[nodiscard]] std::size_t
+        idle_count() const noexcept { return _idle.size(); }
+
+        [[nodiscard]] bool
+        is_owner() const noexcept {
+            return _owner == std::this_thread::get_id();
+        }
+
+    private:
+        void
+        release(std::unique_ptr<arena_type> arena) noexcept {
+            precondition()("arenas are returned on the creating thread"_msg, [this] { return is_owner(); });
+
+            if (_idle.size() >= _max_idle) return;
+            try {
+                arena->reset(_trim, _retain);
+                _idle.push_back(std::move(arena));
+            } catch (...) {
+                // could not keep the arena around, it is just destroyed
+            }
+        }
+
+        std::thread::id _owner = std::this_thread::get_id();
+        allocator_type _allocator{};
+        std::size_t _arena_capacity;
+        arena_trim _trim;
+        std::size_t _retain;
+        std::size_t _max_idle;
+        std::vector<std::unique_ptr<arena_type>> _idle{};
+    };
+}
+
+#endif
@@ -0,0 +1,185 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-27.
+ *
+ * src/haven/mem/credit-limit --
+ *   Implementation of the credit limits bounding outstanding write blocks.
+ */
+
+#include "credit-limit.hxx"
+
+#include <condition_variable>
+#include <memory>
+#include <vector>
+
+#include "../common/check_conditions.hxx"
+
+struct hvn::credit_limit::async_request {
+    struct level : waiter {
+        async_request* request;
+        credit_limit* limit;
+    };
+
+    credit_limit* origin;
+    std::size_t count;
+    continuation_type fn;
+    std::vector<level> levels{};
+
+    // takes the credits level by level, from the origin to the root, then
+    // hands them over to fn, destroying the request
+    void
+    take_from(std::size_t idx) noexcept {
+        if (idx == levels.size()) {
+            std::unique_ptr<async_request> done(this);
+            done->fn(credit_grant{origin, count});
+            return;
+        }
+        levels[idx].limit->take_async(&levels[idx]);
+    }
+
+    static void
+    taken(waiter* w) noexcept {
+        auto lvl = static_cast<level*>(w);
+        auto self = lvl->request;
+        self->take_from(static_cast<std::size_t>(lvl - self->levels.data()) + 1);
+    }
+};
+
+void
+hvn::credit_grant::reset() noexcept {
+    if (_limit == nullptr) return;
+    std::exchange(_limit, nullptr)->give_back(nullptr, std::exchange(_count, 0));
+}
+
+hvn::credit_limit::credit_limit(std::size_t limit, credit_limit* parent) noexcept
+     : _limit(limit),
+       _parent(parent),
+       _available(limit) { }
+
+bool
+hvn::credit_limit::fits(std::size_t count) const noexcept {
+    for (auto limit = this; limit != nullptr; limit = limit->_parent) {
+        if (count > limit->_limit) return false;
+    }
+    return true;
+}
+
+bool
+hvn::credit_limit::try_take(std::size_t count) noexcept {
+    if (_waiter_count.load(std::memory_order_seq_cst) > 0) return false;
+
+    auto available = _available.load(std::memory_order_relaxed);
+    do {
+        if (available < count) return false;
+    } while (!_available.compare_exchange_weak(available,
+                                               available - count,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed));
+    return true;
+}
+
+hvn::credit_grant
+hvn::credit_limit::try_acquire(std::size_t count) noexcept {
+    precondition()("more credits than any of the limits can never be acquired"_msg,
+                   [this](auto count) { return fits(count); },
+                   count);
+
+    for (auto limit = this; limit != nullptr; limit = limit->_parent) {
+        if (limit->try_take(count)) continue;
+
+        // give back what was taken from the limits below
+        give_back(limit, count);
+        return {};
+    }
+    return {this, count};
+}
+
+void
+hvn::credit_limit::take_async(waiter* w) noexcept {
+    {
+        std::scoped_lock lck(_waiters_mx);
+        w->next = nullptr;
+        if (_last_waiter != nullptr) _last_waiter->next = w;
+        else _first_waiter = w;
+        _last_waiter = w;
+        _waiter_count.fetch_add(1, std::memory_order_seq_cst);
+    }
+    // credits returned before we were counted went unnoticed by give_back
+    serve();
+}
+
+void
+hvn::credit_limit::acquire_async(std::size_t count, continuation_type fn) {
+    precondition()("more credits than any of the limits can never be acquired"_msg,
+                   [this](auto count) { return fits(count); },
+                   count);
+
+    auto request = std::make_unique<async_request>(async_request{this, count, std::move(fn)});
+    std::size_t depth = 0;
+    for (auto limit = this; limit != nullptr; limit = limit->_parent) ++depth;
+    request->levels.reserve(depth);
+    for (auto limit = this; limit != nullptr; limit = limit->_parent) {
+        request->levels.push_back({{count, &async_request::taken}, request.get(), limit});
+    }
+    request.release()->take_from(0);
+}
+
+hvn::credit_grant
+hvn::credit_limit::acquire(std::size_t count) {
+    if (auto grant = try_acquire(count)) return grant;
+
+    std::mutex mx;
+    std::condition_variable cv;
+    credit_grant ret;
+    bool done = false;
+    acquire_async(count, [&](credit_grant grant) {
+        std::scoped_lock lck(mx);
+        ret = std::move(grant);
+        done = true;
+        cv.notify_one();
+    });
+
+    std::unique_lock lck(mx);
+    cv.wait(lck, [&done] { return done; });
+    return ret;
+}
+
+hvn::credit_limit::waiter*
+hvn::credit_limit::next_served() noexcept {
+    std::scoped_lock lck(_waiters_mx);
+    auto front = _first_waiter;
+    if (front == nullptr) return nullptr;
+
+    auto available = _available.load(std::memory_order_relaxed);
+    do {
+        if (available < front->count) return nullptr;
+    } while (!_available.compare_exchange_weak(available,
+                                               available - front->count,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed));
+    _first_waiter = front->next;
+    if (_first_waiter == nullptr) _last_waiter = nullptr;
+    _waiter_count.fetch_sub(1, std::memory_order_relaxed);
+    return front;
+}
+
+void
+hvn::credit_limit::serve() noexcept {
+    // the continuations are run without holding the mutex, as they go on to
+    // wait on the parent limit, or run user code
+    while (auto w = next_served()) {
+        w->taken(w);
+    }
+}
+
+void
+hvn::credit_limit::give_back(credit_limit* until, std::size_t count) noexcept {
+    for (auto limit = this; limit != until; limit = limit->_parent) {
+        limit->_available.fetch_add(count, std::memory_order_seq_cst);
+        // pairs with take_async counting the waiter before serving
+        if (limit->_waiter_count.load(std::memory_order_seq_cst) > 0) limit->serve();
+    }
+}
@@ -0,0 +1,162 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-27.
+ *
+ * src/haven/mem/credit-limit --
+ *   Credits bounding the number of outstanding write blocks.
+ *   Limits form a tree: a dock's limit has the harbor's limit as its parent,
+ *   and acquiring credits takes them from every limit up to the root.
+ *   Credits are acquired either failing fast, blocking, or asynchronously, in
+ *   which case the continuation is run by the thread returning the credits,
+ *   usually the one dealing with a write's completion.
+ *   Waiters are served in FIFO order, and nobody jumps ahead of them.
+ */
+#ifndef LIBHAVEN_CREDIT_LIMIT_HXX
+#define LIBHAVEN_CREDIT_LIMIT_HXX
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace hvn {
+    struct credit_limit;
+
+    // Credits taken from a limit and all its ancestors, returned on
+    // destruction.
+    struct credit_grant {
+        constexpr credit_grant() noexcept = default;
+
+        credit_grant(credit_grant&& other) noexcept
+             : _limit(std::exchange(other._limit, nullptr)),
+               _count(std::exchange(other._count, 0)) { }
+
+        credit_grant&
+        operator=(credit_grant&& other) noexcept {
+            credit_grant(std::move(other)).swap(*this);
+            return *this;
+        }
+
+        ~credit_grant() noexcept { reset(); }
+
+        [[nodiscard]] std::size_t
+        count() const noexcept { return _count; }
+
+        explicit
+        operator bool() const noexcept { return _limit != nullptr; }
+
+        // returns the credits early
+        void
+        reset() noexcept;
+
+    private:
+        credit_grant(credit_limit* limit, std::size_t count) noexcept
+             : _limit(limit),
+               _count(count) { }
+
+        void
+        swap(credit_grant& other) noexcept {
+            std::swap(_limit, other._limit);
+            std::swap(_count, other._count);
+        }
+
+        credit_limit* _limit = nullptr;
+        std::size_t _count = 0;
+
+        friend credit_limit;
+    };
+
+    struct credit_limit {
+        using continuation_type = std::function<void(credit_grant)>;
+
+        // the parent, if any, must outlive this limit
+        explicit credit_limit(std::size_t limit, credit_limit* parent = nullptr) noexcept;
+
+        credit_limit(const credit_limit&) = delete;
+        credit_limit&
+        operator=(const credit_limit&) = delete;
+
+        [[nodiscard]] std::size_t
+        limit() const noexcept { return _limit; }
+
+        // a snapshot of the credits not acquired from this limit
+        [[nodiscard]] std::size_t
+        available() const noexcept {
+            return _available.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::size_t
+        outstanding() const noexcept {
+            return _limit - available();
+        }
+
+        // fails fast: returns an empty grant if any of the limits is out of
+        // credits, or has others waiting
+        [[nodiscard]] credit_grant
+        try_acquire(std::size_t count = 1) noexcept;
+
+        // blocks until the credits are acquired
+        [[nodiscard]] credit_grant
+        acquire(std::size_t count = 1);
+
+        // calls fn with the grant once the credits are acquired: right away
+        // on the calling thread if they are available, otherwise on the
+        // thread returning the credits
+        // everything needed for waiting is allocated here, returning credits
+        // never allocates; fn must not throw
+        void
+        acquire_async(std::size_t count, continuation_type fn);
+
+    private:
+        // a continuation waiting for credits, linked into the queue of a limit
+        struct waiter {
+            std::size_t count;
+            void (*taken)(waiter*) noexcept;
+            waiter* next = nullptr;
+        };
+
+        // the waiters of an acquire_async, one for every level of the tree
+        struct async_request;
+
+        [[nodiscard]] bool
+        fits(std::size_t count) const noexcept;
+
+        bool
+        try_take(std::size_t count) noexcept;
+
+        // queues the waiter, which is called once its credits have been taken
+        // from this limit only
+        void
+        take_async(waiter* w) noexcept;
+
+        // takes credits for the first waiter, if there are enough, and
+        // returns it to be continued
+        waiter*
+        next_served() noexcept;
+
+        // continues every waiter that can be given credits, in order
+        void
+        serve() noexcept;
+
+        // returns credits to this limit and its ancestors below until
+        void
+        give_back(credit_limit* until, std::size_t count) noexcept;
+
+        std::size_t _limit;
+        credit_limit* _parent;
+        alignas(64) std::atomic<std::size_t> _available;
+        std::atomic<std::size_t> _waiter_count{};
+
+        std::mutex _waiters_mx;
+        waiter* _first_waiter = nullptr;
+        waiter* _last_waiter = nullptr;
+
+        friend credit_grant;
+    };
+}
+
+#endif
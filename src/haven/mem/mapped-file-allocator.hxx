@@ -0,0 +1,201 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-24.
+ *
+ * src/haven/mem/mapped-file-allocator --
+ *   A hvn::allocator handing out pages backed by a file instead of anonymous
+ *   memory.
+ *   The whole capacity of the allocator is mapped shared once, without access;
+ *   reserving carves a range out of it and grows the file to cover it,
+ *   committing makes the range accessible. Decommitted and loaned pages are
+ *   dropped from memory, but their contents stay in the file. Deallocated
+ *   pages are dropped from the file too, unless the allocator persists them.
+ */
+#ifndef LIBHAVEN_MAPPED_FILE_ALLOCATOR_HXX
+#define LIBHAVEN_MAPPED_FILE_ALLOCATOR_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <haven/mem/page-allocator.hxx>
+
+namespace hvn {
+    // what happens to the file contents of deallocated pages
+    enum class mapped_file_mode {
+        scratch, // the contents are discarded, the file may free the blocks
+        persist  // the contents are written back and kept for the next user
+    };
+
+    struct mapped_file_allocator {
+        struct allocated_page {
+            constexpr const static auto name = std::string_view("allocated mapped");
+
+            [[nodiscard]] auto
+            base_addr() const noexcept { return _base_addr; }
+
+            [[nodiscard]] auto
+            size() const noexcept { return _size; }
+
+        private:
+            void* _base_addr;
+            std::size_t _size;
+
+            allocated_page(void* base, std::size_t size)
+                 : _base_addr(base),
+                   _size(size) { }
+
+            friend mapped_file_allocator;
+        };
+
+        struct committed_page {
+            constexpr const static auto name = std::string_view("committed mapped");
+
+            [[nodiscard]] auto
+            base_addr() const noexcept { return _base_addr; }
+
+            [[nodiscard]] auto
+            size() const noexcept { return _size; }
+
+        private:
+            std::byte* _base_addr;
+            std::size_t _size;
+
+            committed_page(std::byte* base, std::size_t size)
+                 : _base_addr(base),
+                   _size(size) { }
+            friend mapped_file_allocator;
+        };
+
+        struct loaned_page {
+            constexpr const static auto name = std::string_view("loaned mapped");
+
+            [[nodiscard]] auto
+            base_addr() const noexcept { return _base_addr; }
+
+            [[nodiscard]] auto
+            size() const noexcept { return _size; }
+
+        private:
+            void* _base_addr;
+            std::size_t _size;
+
+            loaned_page(void* base, std::size_t size)
+                 : _base_addr(base),
+                   _size(size) { }
+            friend mapped_file_allocator;
+        };
+
+        // opens or creates the file at path, which will hold at most capacity
+        // bytes of pages; throws std::system_error if the file cannot be used
+        mapped_file_allocator(const std::filesystem::path& path,
+                              std::size_t capacity,
+                              mapped_file_mode mode = mapped_file_mode::scratch);
+
+        mapped_file_allocator(const mapped_file_allocator&) = delete;
+        mapped_file_allocator&
+        operator=(const mapped_file_allocator&) = delete;
+
+        ~mapped_file_allocator() noexcept;
+
+        [[nodiscard]] static std::size_t
+        page_size() { return page_allocator::page_size(); }
+
+        [[nodiscard]] static std::size_t
+        approx_cache_line1() { return page_allocator::approx_cache_line1(); }
+
+        [[nodiscard]] std::size_t
+        capacity() const noexcept { return _capacity; }
+
+        [[nodiscard]] mapped_file_mode
+        mode() const noexcept { return _mode; }
+
+        // offset of the page inside the backing file
+        template<memory_page P>
+        [[nodiscard]] std::size_t
+        file_offset(const P& page) const noexcept {
+            return static_cast<std::size_t>(static_cast<const std::byte*>(page.base_addr()) - _base_addr);
+        }
+
+        [[nodiscard]] allocated_page
+        reserve(std::size_t wanted_size);
+
+        [[nodiscard]] committed_page
+        commit(allocated_page page);
+
+        [[nodiscard]] committed_page
+        commit(loaned_page page);
+
+        [[nodiscard]] committed_page
+        commit(committed_page page) const { return page; }
+
+        // throws std::system_error if the page could not be written back or
+        // dropped; the page is still committed if writing it back failed
+        [[nodiscard]] allocated_page
+        decommit(committed_page page);
+
+        [[nodiscard]] committed_page
+        allocate(std::size_t size);
+
+        // throws std::system_error if the page could not be released; in
+        // persist mode, if its contents could not be written to the file, in
+        // which case the page is kept as it was
+        void
+        deallocate(committed_page page);
+        void
+        deallocate(allocated_page page);
+        void
+        deallocate(loaned_page page);
+
+        [[nodiscard]] std::variant<loaned_page, allocated_page>
+        loan(allocated_page page);
+
+        [[nodiscard]] std::variant<loaned_page, committed_page>
+        loan(committed_page page);
+
+        [[nodiscard]] allocated_page
+        slice(allocated_page page, std::size_t offset, std::size_t size) const noexcept {
+            precondition()([](auto offset, auto size, auto page_size) { return offset % page_size == 0 && size % page_size == 0; },
+                           offset,
+                           size,
+                           _page_size);
+            precondition()([&page](auto end) { return end <= page.size(); }, offset + size);
+            return {static_cast<std::byte*>(page.base_addr()) + offset, size};
+        }
+
+        // writes every dirty page back to the file, waiting for completion
+        void
+        flush();
+
+    private:
+        // drops the pages from memory, and makes them inaccessible
+        void
+        drop_range(void* base, std::size_t size);
+
+        void
+        release_range(void* base, std::size_t size);
+
+        std::size_t _page_size = page_size();
+        std::size_t _capacity;
+        mapped_file_mode _mode;
+        std::intptr_t _file;
+        std::intptr_t _mapping{}; // only used where mappings are separate objects
+        std::byte* _base_addr;
+
+        std::mutex _range_mx{};
+        std::size_t _used_size{};
+        std::vector<std::pair<std::size_t, std::size_t>> _free_ranges{};
+    };
+    static_assert(allocator<mapped_file_allocator>, "hvn::mapped_file_allocator needs to be a hvn::allocator");
+    static_assert(sliceable_allocator<mapped_file_allocator>, "hvn::mapped_file_allocator needs to be a hvn::sliceable_allocator");
+}
+
+#endif
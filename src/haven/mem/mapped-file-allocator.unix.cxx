@@ -0,0 +1,244 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-24.
+ *
+ * src/haven/mem/mapped-file-allocator.unix --
+ *   POSIX implementation of the hvn::mapped_file_allocator using a shared
+ *   mapping of the file, grown with ftruncate(2).
+ */
+
+#include "mapped-file-allocator.hxx"
+
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/check_conditions.hxx"
+
+hvn::mapped_file_allocator::mapped_file_allocator(const std::filesystem::path& path,
+                                                  std::size_t capacity,
+                                                  mapped_file_mode mode)
+     : _capacity(capacity),
+       _mode(mode) {
+    precondition()([](auto capacity,
+                      auto page_size) { return capacity > 0 && capacity % page_size == 0; },
+                   capacity,
+                   _page_size);
+
+    auto fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) throw std::system_error(errno, std::system_category(), "open");
+
+    // pages past the end of the file are never touched: they are only made
+    // accessible after the file has been grown to cover them
+    void* memory = mmap(nullptr,
+                        _capacity,
+                        PROT_NONE,
+                        MAP_SHARED,
+                        fd,
+                        0);
+    if (memory == MAP_FAILED) {
+        auto err = errno;
+        close(fd);
+        throw std::system_error(err, std::system_category(), "mmap");
+    }
+
+    _file = fd;
+    _base_addr = static_cast<std::byte*>(memory);
+    // an already existing file is kept as is: ranges are reserved from its
+    // start, so the same sequence of reservations finds the same contents
+
+    postcondition()([](auto mem) { return mem != nullptr; }, _base_addr);
+}
+
+hvn::mapped_file_allocator::~mapped_file_allocator() noexcept {
+    msync(_base_addr, _capacity, MS_SYNC);
+    munmap(_base_addr, _capacity);
+    close(static_cast<int>(_file));
+}
+
+hvn::mapped_file_allocator::allocated_page
+hvn::mapped_file_allocator::reserve(std::size_t size) {
+    precondition()([](auto wanted_size,
+                      auto page_size) { return wanted_size > 0 && wanted_size % page_size == 0; },
+                   size,
+                   _page_size);
+
+    std::scoped_lock lck(_range_mx);
+    auto reusable = std::ranges::find_if(_free_ranges, [size](const auto& range) {
+        return range.second == size;
+    });
+    if (reusable != _free_ranges.end()) {
+        auto offset = reusable->first;
+        _free_ranges.erase(reusable);
+        return {_base_addr + offset, size};
+    }
+
+    if (_capacity - _used_size < size) throw std::bad_alloc{};
+    auto offset = _used_size;
+
+    struct stat st {};
+    if (fstat(static_cast<int>(_file), &st) != 0) throw std::bad_alloc{};
+    if (static_cast<std::size_t>(st.st_size) < offset + size
+        && ftruncate(static_cast<int>(_file), static_cast<off_t>(offset + size)) != 0) throw std::bad_alloc{};
+    _used_size += size;
+
+    return {_base_addr + offset, size};
+}
+
+hvn::mapped_file_allocator::committed_page
+hvn::mapped_file_allocator::commit(mapped_file_allocator::allocated_page page) {
+    precondition()([](auto addr) { return addr != nullptr; }, page.base_addr());
+    precondition()([](auto wanted_size,
+                      auto page_size) { return wanted_size % page_size == 0; },
+                   page.size(),
+                   _page_size);
+
+    auto succ = mprotect(page.base_addr(),
+                         page.size(),
+                         PROT_READ | PROT_WRITE);
+    if (succ != 0) throw std::bad_alloc{};
+
+    return {static_cast<std::byte*>(page.base_addr()), page.size()};
+}
+
+hvn::mapped_file_allocator::committed_page
+hvn::mapped_file_allocator::commit(mapped_file_allocator::loaned_page page) {
+    precondition()([](auto addr) { return addr != nullptr; }, page.base_addr());
+    precondition()([](auto size) { return size != 0; }, page.size());
+
+    // loaned pages stay accessible, touching them reads them back from the file
+    return {static_cast<std::byte*>(page.base_addr()), page.size()};
+}
+
+hvn::mapped_file_allocator::allocated_page
+hvn::mapped_file_allocator::decommit(mapped_file_allocator::committed_page page) {
+    precondition()([](auto addr) { return addr != nullptr; }, page.base_addr());
+    precondition()([](auto size) { return size > 0; }, page.size());
+
+    // the page is only dropped once its contents are safe in the file
+    auto succ = msync(page.base_addr(),
+                      page.size(),
+                      MS_ASYNC);
+    if (succ != 0) throw std::system_error(errno, std::system_category(), "msync");
+    drop_range(page.base_addr(), page.size());
+
+    return {page.base_addr(), page.size()};
+}
+
+hvn::mapped_file_allocator::committed_page
+hvn::mapped_file_allocator::allocate(std::size_t size) {
+    return commit(reserve(size));
+}
+
+void
+hvn::mapped_file_allocator::drop_range(void* base, std::size_t size) {
+    auto succ = madvise(base,
+                        size,
+                        MADV_DONTNEED);
+    if (succ != 0) throw std::system_error(errno, std::system_category(), "madvise");
+    succ = mprotect(base,
+                    size,
+                    PROT_NONE);
+    if (succ != 0) throw std::system_error(errno, std::system_category(), "mprotect");
+}
+
+void
+hvn::mapped_file_allocator::release_range(void* base, std::size_t size) {
+    precondition()([](auto addr) { return addr != nullptr; }, base);
+    precondition()([](auto size) { return size > 0; }, size);
+
+    auto offset = static_cast<std::size_t>(static_cast<std::byte*>(base) - _base_addr);
+    if (_mode == mapped_file_mode::persist) {
+        // written back synchronously, so a failed write is reported here
+        auto succ = msync(base,
+                          size,
+                          MS_SYNC);
+        if (succ != 0) throw std::system_error(errno, std::system_category(), "msync");
+
+        // pages cut off by truncating the file behind our back are lost
+        struct stat st {};
+        if (fstat(static_cast<int>(_file), &st) != 0) throw std::system_error(errno, std::system_category(), "fstat");
+        if (static_cast<std::size_t>(st.st_size) < offset + size) {
+            throw std::system_error(std::make_error_code(std::errc::io_error), "the file no longer holds the pages");
+        }
+    }
+    drop_range(base, size);
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // the contents are not needed anymore, nothing to write back
+    if (_mode == mapped_file_mode::scratch) {
+        auto succ = fallocate(static_cast<int>(_file),
+                              FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                              static_cast<off_t>(offset),
+                              static_cast<off_t>(size));
+        // file systems without holes just keep the blocks
+        if (succ != 0 && errno != EOPNOTSUPP && errno != ENOSYS) {
+            throw std::system_error(errno, std::system_category(), "fallocate");
+        }
+    }
+#endif
+
+    std::scoped_lock lck(_range_mx);
+    _free_ranges.emplace_back(offset, size);
+}
+
+void
+hvn::mapped_file_allocator::deallocate(mapped_file_allocator::committed_page page) {
+    release_range(page.base_addr(), page.size());
+}
+
+void
+hvn::mapped_file_allocator::deallocate(mapped_file_allocator::allocated_page page) {
+    release_range(page.base_addr(), page.size());
+}
+
+void
+hvn::mapped_file_allocator::deallocate(mapped_file_allocator::loaned_page page) {
+    release_range(page.base_addr(), page.size());
+}
+
+std::variant<hvn::mapped_file_allocator::loaned_page,
+             hvn::mapped_file_allocator::allocated_page>
+hvn::mapped_file_allocator::loan(mapped_file_allocator::allocated_page page) {
+    return page;
+}
+
+std::variant<hvn::mapped_file_allocator::loaned_page,
+             hvn::mapped_file_allocator::committed_page>
+hvn::mapped_file_allocator::loan(mapped_file_allocator::committed_page page) {
+    // dirty pages are written back to the file, then dropped from memory
+    auto succ = msync(page.base_addr(),
+                      page.size(),
+                      MS_ASYNC);
+    if (succ != 0)
+        return page;
+    succ = madvise(page.base_addr(),
+                   page.size(),
+                   MADV_DONTNEED);
+    if (succ != 0)
+        return page;
+
+    return loaned_page{page.base_addr(), page.size()};
+}
+
+void
+hvn::mapped_file_allocator::flush() {
+    std::size_t used;
+    {
+        std::scoped_lock lck(_range_mx);
+        used = _used_size;
+    }
+    if (used == 0) return;
+
+    auto succ = msync(_base_addr, used, MS_SYNC);
+    if (succ != 0) throw std::system_error(errno, std::system_category(), "msync");
+}
@@ -0,0 +1,246 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-24.
+ *
+ * src/haven/mem/mapped-file-allocator.win --
+ *   Windows implementation of the hvn::mapped_file_allocator using a view of
+ *   a file mapping object.
+ *   File mappings cannot outgrow their file, so the file is extended to the
+ *   full capacity up front, but it is marked sparse if the file system allows.
+ */
+
+#include "mapped-file-allocator.hxx"
+
+#include <algorithm>
+#include <new>
+#include <system_error>
+
+#ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#  define NOMINMAX
+#endif
+#include <windows.h>
+#include <winioctl.h>
+
+#include "../common/check_conditions.hxx"
+
+namespace {
+    HANDLE
+    as_handle(std::intptr_t value) noexcept {
+        return reinterpret_cast<HANDLE>(value);
+    }
+
+    [[noreturn]] void
+    throw_last_error(const char* what) {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+    }
+}
+
+hvn::mapped_file_allocator::mapped_file_allocator(const std::filesystem::path& path,
+                                                  std::size_t capacity,
+                                                  mapped_file_mode mode)
+     : _capacity(capacity),
+       _mode(mode) {
+    precondition()([](auto capacity,
+                      auto page_size) { return capacity > 0 && capacity % page_size == 0; },
+                   capacity,
+                   _page_size);
+
+    HANDLE file = CreateFileW(path.c_str(),
+                              GENERIC_READ | GENERIC_WRITE,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw_last_error("CreateFileW");
+
+    // best effort, if it fails the file is just fully allocated on the disk
+    DWORD returned;
+    DeviceIoControl(file, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+
+    ULARGE_INTEGER size;
+    size.QuadPart = _capacity;
+    HANDLE mapping = CreateFileMappingW(file,
+                                        nullptr,
+                                        PAGE_READWRITE,
+                                        size.HighPart,
+                                        size.LowPart,
+                                        nullptr);
+    if (mapping == nullptr) {
+        auto err = GetLastError();
+        CloseHandle(file);
+        throw std::system_error(static_cast<int>(err), std::system_category(), "CreateFileMappingW");
+    }
+
+    LPVOID memory = MapViewOfFile(mapping,
+                                  FILE_MAP_READ | FILE_MAP_WRITE,
+                                  0,
+                                  0,
+                                  _capacity);
+    DWORD old_protect;
+    if (memory == nullptr
+        || !VirtualProtect(memory, _capacity, PAGE_NOACCESS, &old_protect)) {
+        auto err = GetLastError();
+        if (memory) UnmapViewOfFile(memory);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::system_error(static_cast<int>(err), std::system_category(), "MapViewOfFile");
+    }
+
+    _file = reinterpret_cast<std::intptr_t>(file);
+    _mapping = reinterpret_cast<std::intptr_t>(mapping);
+    _base_addr = static_cast<std::byte*>(memory);
+    // an already existing file is kept as is: ranges are reserved from its
+    // start, so the same sequence of reservations finds the same contents
+
+    postcondition()([](auto mem) { return mem != nullptr; }, _base_addr);
+}
+
+hvn::mapped_file_allocator::~mapped_file_allocator() noexcept {
+    FlushViewOfFile(_base_addr, _capacity);
+    UnmapViewOfFile(_base_addr);
+    CloseHandle(as_handle(_mapping));
+    FlushFileBuffers(as_handle(_file));
+    CloseHandle(as_handle(_file));
+}
+
+hvn::mapped_file_allocator::allocated_page
+hvn::mapped_file_allocator::reserve(std::size_t size) {
+    precondition()([](auto wanted_size,
+                      auto page_size) { return wanted_size > 0 && wanted_size % page_size == 0; },
+                   size,
+                   _page_size);
+
+    std::scoped_lock lck(_range_mx);
+    auto reusable = std::ranges::find_if(_free_ranges, [size](const auto& range) {
+        return range.second == size;
+    });
+    if (reusable != _free_ranges.end()) {
+        auto offset = reusable->first;
+        _free_ranges.erase(reusable);
+        return {_base_addr + offset, size};
+    }
+
+    if (_capacity - _used_size < size) throw std::bad_alloc{};
+    auto offset = _used_size;
+    _used_size += size;
+
+    return {_base_addr + offset, size};
+}
+
+hvn::mapped_file_allocator::committed_page
+hvn::mapped_file_allocator::commit(mapped_file_allocator::allocated_page page) {
+    precondition()([](auto addr) { return addr != nullptr; }, page.base_addr());
+    precondition()([](auto wanted_size,
+                      auto page_size) { return wanted_size % page_size == 0; },
+                   page.size(),
+                   _page_size);
+
+    DWORD old_protect;
+    if (!VirtualProtect(page.base_addr(), page.size(), PAGE_READWRITE, &old_protect)) throw std::bad_alloc{};
+
+    return {static_cast<std::byte*>(page.base_addr()), page.size()};
+}
+
+hvn::mapped_file_allocator::committed_page
+hvn::mapped_file_allocator::commit(mapped_file_allocator::loaned_page page) {
+    precondition()([](auto addr) { return addr != nullptr; }, page.base_addr());
+    precondition()([](auto size) { return size != 0; }, page.size());
+
+    // loaned pages stay accessible, touching them reads them back from the file
+    return {static_cast<std::byte*>(page.base_addr()), page.size()};
+}
+
+hvn::mapped_file_allocator::allocated_page
+hvn::mapped_file_allocator::decommit(mapped_file_allocator::committed_page page) {
+    precondition()([](auto addr) { return addr != nullptr; }, page.base_addr());
+    precondition()([](auto size) { return size > 0; }, page.size());
+
+    // the page is only dropped once its contents are safe in the file
+    if (!FlushViewOfFile(page.base_addr(), page.size())) throw_last_error("FlushViewOfFile");
+    drop_range(page.base_addr(), page.size());
+
+    return {page.base_addr(), page.size()};
+}
+
+hvn::mapped_file_allocator::committed_page
+hvn::mapped_file_allocator::allocate(std::size_t size) {
+    return commit(reserve(size));
+}
+
+void
+hvn::mapped_file_allocator::drop_range(void* base, std::size_t size) {
+    // unlocking pages that are not locked removes them from the working set
+    VirtualUnlock(base, size);
+    DWORD old_protect;
+    if (!VirtualProtect(base, size, PAGE_NOACCESS, &old_protect)) throw_last_error("VirtualProtect");
+}
+
+void
+hvn::mapped_file_allocator::release_range(void* base, std::size_t size) {
+    precondition()([](auto addr) { return addr != nullptr; }, base);
+    precondition()([](auto size) { return size > 0; }, size);
+
+    // blocks of a mapped file cannot be freed, so scratch pages are only
+    // dropped from memory
+    if (_mode == mapped_file_mode::persist) {
+        if (!FlushViewOfFile(base, size)) throw_last_error("FlushViewOfFile");
+        if (!FlushFileBuffers(as_handle(_file))) throw_last_error("FlushFileBuffers");
+    }
+    drop_range(base, size);
+
+    auto offset = static_cast<std::size_t>(static_cast<std::byte*>(base) - _base_addr);
+    std::scoped_lock lck(_range_mx);
+    _free_ranges.emplace_back(offset, size);
+}
+
+void
+hvn::mapped_file_allocator::deallocate(mapped_file_allocator::committed_page page) {
+    release_range(page.base_addr(), page.size());
+}
+
+void
+hvn::mapped_file_allocator::deallocate(mapped_file_allocator::allocated_page page) {
+    release_range(page.base_addr(), page.size());
+}
+
+void
+hvn::mapped_file_allocator::deallocate(mapped_file_allocator::loaned_page page) {
+    release_range(page.base_addr(), page.size());
+}
+
+std::variant<hvn::mapped_file_allocator::loaned_page,
+             hvn::mapped_file_allocator::allocated_page>
+hvn::mapped_file_allocator::loan(mapped_file_allocator::allocated_page page) {
+    return page;
+}
+
+std::variant<hvn::mapped_file_allocator::loaned_page,
+             hvn::mapped_file_allocator::committed_page>
+hvn::mapped_file_allocator::loan(mapped_file_allocator::committed_page page) {
+    // dirty pages are written back to the file, then dropped from memory
+    if (!FlushViewOfFile(page.base_addr(), page.size()))
+        return page;
+    VirtualUnlock(page.base_addr(), page.size());
+
+    return loaned_page{page.base_addr(), page.size()};
+}
+
+void
+hvn::mapped_file_allocator::flush() {
+    std::size_t used;
+    {
+        std::scoped_lock lck(_range_mx);
+        used = _used_size;
+    }
+    if (used == 0) return;
+
+    if (!FlushViewOfFile(_base_addr, used)) throw_last_error("FlushViewOfFile");
+    if (!FlushFileBuffers(as_handle(_file))) throw_last_error("FlushFileBuffers");
+}
@@ -0,0 +1,170 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-22.
+ *
+ * src/haven/mem/owned-pool --
+ *   A pool owned by a single thread, made up of owned puddles.
+ *   The owner allocates, and grows the pool, without any locking; any thread
+ *   may deallocate, which is deferred to the owner of the puddle by its
+ *   remote free list. Meant for objects allocated by one thread and freed by
+ *   another, like jobs submitted by a thread and completed by any: every
+ *   submitting thread has a pool of its own.
+ */
+#ifndef LIBHAVEN_OWNED_POOL_HXX
+#define LIBHAVEN_OWNED_POOL_HXX
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include <haven/common/check_conditions.hxx>
+#include <haven/mem/owned-puddle.hxx>
+#include <haven/mem/page-allocator.hxx>
+#include <haven/mem/slot-layout.hxx>
+
+namespace hvn {
+    template<class T,
+             allocator Allocator = page_allocator,
+             slot_layout Layout = packed_layout>
+    struct owned_pool {
+        using value_type = T;
+        using allocator_type = Allocator;
+        using layout_type = Layout;
+        using puddle_type = owned_puddle<T, Allocator, Layout>;
+
+        // the constructing thread becomes the owner of the pool
+        owned_pool()
+            requires(std::default_initializable<allocator_type>) {
+            add_puddle();
+        }
+
+        // constructs the pool's allocator from the given arguments
+        template<class... AllocatorArgs>
+        explicit owned_pool(std::in_place_t, AllocatorArgs&&... args)
+             : _allocator(std::forward<AllocatorArgs>(args)...) {
+            add_puddle();
+        }
+
+        owned_pool(const owned_pool&) = delete;
+        owned_pool&
+        operator=(const owned_pool&) = delete;
+
+        ~owned_pool() noexcept {
+            for (auto& segment : _segments) {
+                delete[] segment.load(std::memory_order_relaxed);
+            }
+        }
+
+        [[nodiscard]] std::thread::id
+        owner() const noexcept { return _owner; }
+
+        [[nodiscard]] bool
+        is_owner() const noexcept { return _owner == std::this_thread::get_id(); }
+
+        [[nodiscard]] std::size_t
+        puddle_count() const noexcept { return _puddle_count.load(std::memory_order_acquire); }
+
+        // allocates from the puddle that last had room, then from the others,
+        // growing the pool if all of them are full
+        template<class... Args>
+        [[nodiscard]] T*
+        allocate(Args&&... args) {
+            precondition()("only the owner thread may allocate"_msg, [this] { return is_owner(); });
+
+            auto count = _puddle_count.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < count; ++i) {
+                auto idx = (_current + i) % count;
+                if (auto ret = at(idx)->try_allocate(std::forward<Args>(args)...)) {
+                    _current = idx;
+                    return ret;
+                }
+            }
+            _current = add_puddle();
+            return at(_current)->try_allocate(std::forward<Args>(args)...);
+        }
+
+        // may be called from any thread
+        void
+        deallocate(T* mem) {
+            auto count = _puddle_count.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < count; ++i) {
+                auto puddle = at(i);
+                if (!puddle->owns(mem)) continue;
+                std::ignore = puddle->deallocate(mem);
+                return;
+            }
+        }
+
+        // releases the slots freed by other threads in every puddle
+        std::size_t
+        reclaim_remote() {
+            std::size_t ret = 0;
+            auto count = _puddle_count.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < count; ++i) {
+                ret += at(i)->reclaim_remote();
+            }
+            return ret;
+        }
+
+        // loans the pages of empty puddles back to the allocator
+        void
+        trim() {
+            auto count = _puddle_count.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < count; ++i) {
+                at(i)->trim();
+            }
+        }
+
+    private:
+        // the puddles are stored in segments of growing size, 1, 2, 4, ...
+        // so they never move, and other threads can look for the puddle of
+        // the memory they free without locking
+        constexpr const static auto directory_segments = std::size_t{32};
+
+        static std::pair<std::size_t, std::size_t>
+        locate(std::size_t idx) noexcept {
+            auto segment = static_cast<std::size_t>(std::bit_width(idx + 1)) - 1;
+            return {segment, idx + 1 - (std::size_t{1} << segment)};
+        }
+
+        puddle_type*
+        at(std::size_t idx) const noexcept {
+            auto [segment, offset] = locate(idx);
+            return _segments[segment].load(std::memory_order_acquire)[offset].get();
+        }
+
+        // owner only
+        std::size_t
+        add_puddle() {
+            auto idx = _puddle_count.load(std::memory_order_relaxed);
+            auto [segment, offset] = locate(idx);
+            precondition()([](auto segment) { return segment < directory_segments; }, segment);
+
+            auto entries = _segments[segment].load(std::memory_order_relaxed);
+            if (entries == nullptr) {
+                entries = new std::unique_ptr<puddle_type>[std::size_t{1} << segment];
+                _segments[segment].store(entries, std::memory_order_release);
+            }
+            entries[offset] = std::make_unique<puddle_type>(&_allocator);
+            _puddle_count.store(idx + 1, std::memory_order_release);
+            return idx;
+        }
+
+        std::thread::id _owner = std::this_thread::get_id();
+        allocator_type _allocator{};
+        std::array<std::atomic<std::unique_ptr<puddle_type>*>, directory_segments> _segments{};
+        std::atomic<std::size_t> _puddle_count{};
+        std::size_t _current{}; // owner only
+    };
+}
+
+#endif
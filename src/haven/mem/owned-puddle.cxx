@@ -0,0 +1,13 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-22.
+ *
+ * src/haven/mem/owned-puddle --
+ *   Source file for the hvn::owned_puddle class.
+ *   Used to ensure clean inclusion.
+ */
+
+#include "owned-puddle.hxx"
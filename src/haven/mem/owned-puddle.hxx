@@ -0,0 +1,262 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-22.
+ *
+ * src/haven/mem/owned-puddle --
+ *   A puddle owned by a single thread.
+ *   The owner thread allocates and deallocates without any synchronization.
+ *   Other threads may only deallocate: their frees are pushed onto a lock-free
+ *   multi-producer single-consumer list, which the owner reclaims in bulk
+ *   when it runs out of empty slots.
+ */
+#ifndef LIBHAVEN_OWNED_PUDDLE_HXX
+#define LIBHAVEN_OWNED_PUDDLE_HXX
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <haven/common/check_conditions.hxx>
+#include <haven/mem/page-allocator.hxx>
+#include <haven/mem/slot-ctrl.hxx>
+#include <haven/mem/slot-layout.hxx>
+
+namespace hvn {
+    template<class T,
+             allocator Allocator = page_allocator,
+             slot_layout Layout = packed_layout>
+    struct owned_puddle {
+        using value_type = T;
+        using allocator_type = Allocator;
+        using layout_type = Layout;
+
+        // the constructing thread becomes the owner of the puddle
+        owned_puddle(allocator_type* allocator)
+             : _allocator(allocator),
+               _stride(Layout::template stride<T>(_allocator->approx_cache_line1())),
+               _ctrl(slot_span_size(_stride, _allocator->page_size()) / _stride),
+               _remote_next(_ctrl.size(), no_slot),
+               _state(_allocator->reserve(slot_span_size(_stride, _allocator->page_size()))) {
+            precondition()("over-alignment is at most the page size"_msg,
+                           [](auto page_size) { return alignof(T) <= page_size; },
+                           _allocator->page_size());
+            postcondition()([](auto stride) { return stride % alignof(T) == 0; }, _stride);
+            postcondition()([](auto size) { return size > 0 && size < no_slot; }, _ctrl.size());
+        }
+
+        owned_puddle(const owned_puddle&) = delete;
+        owned_puddle&
+        operator=(const owned_puddle&) = delete;
+
+        [[nodiscard]] std::size_t
+        capacity() const noexcept {
+            return _ctrl.size();
+        }
+
+        [[nodiscard]] std::size_t
+        stride() const noexcept {
+            return _stride;
+        }
+
+        [[nodiscard]] std::thread::id
+        owner() const noexcept {
+            return _owner;
+        }
+
+        [[nodiscard]] bool
+        is_owner() const noexcept {
+            return _owner == std::this_thread::get_id();
+        }
+
+        template<class... Args>
+        [[nodiscard]] T*
+        try_allocate(Args&&... args) {
+            precondition()("only the owner thread may allocate"_msg, [this] { return is_owner(); });
+
+            if (!valid_memory()) retake_buffer();
+
+            auto idx = _ctrl.claim_empty();
+            if (idx == slot_ctrl::npos && reclaim_remote() > 0) {
+                idx = _ctrl.claim_empty();
+            }
+            if (idx == slot_ctrl::npos) return nullptr;
+#ifdef HAVEN_DBG_PUDDLE_TRACE
+            ++_allocated_count;
+#endif
+
+            auto& page = std::get<typename allocator_type::committed_page>(_state);
+            return std::construct_at(reinterpret_cast<T*>(page.base_addr() + idx * _stride), std::forward<Args>(args)...);
+        }
+
+        // may be called from any thread
+        // non-owner threads defer releasing the slot to the owner
+        [[nodiscard]] bool
+        deallocate(T* ptr) {
+            if (ptr == nullptr) return true;
+            // other threads only look at the cached address, the state of the
+            // page is the owner's to read and change
+            if (!owns(ptr)) return false;
+            auto by_owner = is_owner();
+            if (by_owner) precondition()([this] { return valid_memory(); });
+
+            std::destroy_at(ptr);
+            auto idx = static_cast<std::uint32_t>(static_cast<std::size_t>(reinterpret_cast<std::byte*>(ptr) - _base_addr) / _stride);
+
+            if (by_owner) {
+                _ctrl.release(idx);
+#ifdef HAVEN_DBG_PUDDLE_TRACE
+                ++_deallocated_count;
+#endif
+                return true;
+            }
+
+            auto head = _remote_head.load(std::memory_order_relaxed);
+            do {
+                _remote_next[idx] = head;
+            } while (!_remote_head.compare_exchange_weak(head,
+                                                         idx,
+                                                         std::memory_order_release,
+                                                         std::memory_order_relaxed));
+            return true;
+        }
+
+        // releases all slots freed by other threads since the last reclaim
+        // returns the number of slots reclaimed
+        std::size_t
+        reclaim_remote() {
+            precondition()("only the owner thread may reclaim"_msg, [this] { return is_owner(); });
+
+            std::size_t count = 0;
+            auto idx = _remote_head.exchange(no_slot, std::memory_order_acquire);
+            while (idx != no_slot) {
+                _ctrl.release(idx);
+                idx = std::exchange(_remote_next[idx], no_slot);
+                ++count;
+            }
+#ifdef HAVEN_DBG_PUDDLE_TRACE
+            _deallocated_count += count;
+#endif
+            return count;
+        }
+
+        // loans the page back to the allocator if all slots are empty,
+        // including the ones freed remotely
+        void
+        trim() {
+            precondition()("only the owner thread may trim"_msg, [this] { return is_owner(); });
+            if (!valid_memory()) return;
+
+            std::ignore = reclaim_remote();
+            if (_ctrl.any_used()) return;
+            _state = std::visit(
+                   [](const auto& page) -> state_type {
+                       return page;
+                   },
+                   _allocator->loan(std::get<typename allocator_type::committed_page>(_state)));
+        }
+
+        // may be called from any thread: the page keeps its address in every
+        // state, so it is not read from the state the owner may change
+        [[nodiscard]] bool
+        owns(const T* ptr) const noexcept {
+            auto addr = reinterpret_cast<const std::byte*>(ptr);
+            return _base_addr <= addr && addr < _base_addr + _ctrl.size() * _stride;
+        }
+
+        ~owned_puddle() noexcept {
+            // frees pushed by other threads after the owner's last reclaim
+            auto idx = _remote_head.exchange(no_slot, std::memory_order_acquire);
+            while (idx != no_slot) {
+                _ctrl.release(idx);
+                idx = _remote_next[idx];
+#ifdef HAVEN_DBG_PUDDLE_TRACE
+                ++_deallocated_count;
+#endif
+            }
+#ifdef HAVEN_DBG_PUDDLE_TRACE
+            try {
+                std::osyncstream ostr(std::cerr);
+                ostr << "owned_puddle@" << static_cast<void*>(this) << "\n";
+                ostr << "\tlifetime allocated: " << _allocated_count << "\n";
+                ostr << "\tlifetime deallocated: " << _deallocated_count << "\n";
+                bool good = true;
+                auto base_addr = std::visit(
+                       [](const auto& page) {
+                           return static_cast<std::byte*>(page.base_addr());
+                       },
+                       _state);
+                for (std::size_t i = 0; i < _ctrl.size(); ++i) {
+                    if (_ctrl.is_used(i)) {
+                        if (good) {
+                            ostr << "\t!! the elements at the following memory addresses have not been deallocated !!\n";
+                            good = false;
+                        }
+                        ostr << "\t\t- " << base_addr + _stride * i << "\n";
+                    }
+                }
+                if (good) {
+                    ostr << "\t.. puddle has deallocated all contained items ..\n";
+                }
+            } catch (...) {
+                // debug related logging failed, oh well
+            }
+#endif
+            std::visit(
+                   [&_allocator = *_allocator](const auto& page) {
+                       _allocator.deallocate(page);
+                   },
+                   _state);
+        }
+
+    private:
+        constexpr const static auto no_slot = std::uint32_t(-1);
+
+        using state_type = std::variant<typename allocator_type::allocated_page,
+                                        typename allocator_type::committed_page,
+                                        typename allocator_type::loaned_page>;
+
+        void
+        retake_buffer() {
+            _state = std::visit(
+                   [&_allocator = *_allocator](const auto& page) {
+                       return _allocator.commit(page);
+                   },
+                   _state);
+
+            postcondition()([this](auto) { return valid_memory(); }, _state.index());
+        }
+
+        bool
+        valid_memory() const noexcept {
+            return std::holds_alternative<typename Allocator::committed_page>(_state);
+        }
+
+        std::thread::id _owner = std::this_thread::get_id();
+        allocator_type* _allocator;
+        std::size_t _stride;
+        slot_ctrl _ctrl;
+        // intrusive links of the remote free list, indexed by slot
+        // written by the freeing thread before publishing the slot on _remote_head
+        std::vector<std::uint32_t> _remote_next;
+        alignas(64) std::atomic<std::uint32_t> _remote_head{no_slot};
+        state_type _state;
+        std::byte* _base_addr = std::visit(
+               [](const auto& page) {
+                   return static_cast<std::byte*>(page.base_addr());
+               },
+               _state);
+#ifdef HAVEN_DBG_PUDDLE_TRACE
+        std::size_t _allocated_count{};
+        std::size_t _deallocated_count{};
+#endif
+    };
+}
+
+#endif
@@ -15,6 +15,8 @@
 #include <string_view>
 #include <variant>
 
+#include <haven/common/check_conditions.hxx>
+
 #ifdef HAVEN_DBG_PAGE_TRACE
 #  include <iostream>
 #  include <syncstream>
@@ -73,6 +75,34 @@ namespace hvn {
                { alloc.page_size() } -> std::unsigned_integral;
            };
 
+    // allocators that can hand out parts of a reserved page, so the parts can
+    // be committed, decommitted, and loaned one by one
+    // slices share the reservation of the page: only the whole page may be
+    // deallocated
+    template<class A>
+    concept sliceable_allocator =
+           allocator<A>
+           && requires(A alloc) {
+                  { alloc.slice(std::declval<typename A::allocated_page>(),
+                                std::declval<std::size_t>(),
+                                std::declval<std::size_t>()) } -> std::same_as<typename A::allocated_page>;
+              };
+
+    // how memory made ready ahead of its first use is treated
+    enum class page_prefault {
+        lazy,     // only committed, the first access to each page faults it in
+        populate, // committed and faulted in right away
+    };
+
+    // writes every page of the range, so the os backs all of them with memory
+    inline void
+    touch_pages(std::byte* base, std::size_t size, std::size_t page_size) noexcept {
+        for (std::size_t offset = 0; offset < size; offset += page_size) {
+            auto byte = static_cast<volatile std::byte*>(base + offset);
+            *byte = *byte;
+        }
+    }
+
     struct page_allocator {
         struct allocated_page {
             constexpr const static auto name = std::string_view("allocated");
@@ -169,6 +199,20 @@ namespace hvn {
         [[nodiscard]] std::variant<loaned_page, committed_page>
         loan(committed_page page);
 
+        // faults in every page of the committed page
+        void
+        prefault(committed_page page) const;
+
+        [[nodiscard]] allocated_page
+        slice(allocated_page page, std::size_t offset, std::size_t size) const noexcept {
+            precondition()([](auto offset, auto size, auto page_size) { return offset % page_size == 0 && size % page_size == 0; },
+                           offset,
+                           size,
+                           _page_size);
+            precondition()([&page](auto end) { return end <= page.size(); }, offset + size);
+            return {static_cast<std::byte*>(page.base_addr()) + offset, size};
+        }
+
 #ifdef HAVEN_DBG_PAGE_TRACE
         ~page_allocator() noexcept {
             try {
@@ -206,6 +250,20 @@ namespace hvn {
 #endif
     };
     static_assert(allocator<page_allocator>, "hvn::page_allocator needs to be a hvn::allocator");
+    static_assert(sliceable_allocator<page_allocator>, "hvn::page_allocator needs to be a hvn::sliceable_allocator");
+
+    // faults in the page with the means of the allocator if it has any,
+    // otherwise by touching every page
+    template<allocator A>
+    void
+    prefault(A& alloc, const typename A::committed_page& page) {
+        if constexpr (requires { alloc.prefault(page); }) {
+            alloc.prefault(page);
+        }
+        else {
+            touch_pages(page.base_addr(), page.size(), alloc.page_size());
+        }
+    }
 }
 
 #endif
@@ -0,0 +1,225 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-24.
+ *
+ * src/haven/mem/page-allocator.unix --
+ *   POSIX implementation of the hvn::page_allocator using mmap(2) and friends.
+ */
+
+#include "page-allocator.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../common/check_conditions.hxx"
+#include "../common/trace.hxx"
+
+std::size_t
+hvn::page_allocator::figure_out_page_size() noexcept {
+    auto ret = sysconf(_SC_PAGESIZE);
+
+    postcondition()("page size is zero"_msg, [ret] { return ret > 0; });
+    return static_cast<std::size_t>(ret);
+}
+
+hvn::page_allocator::allocated_page
+hvn::page_allocator::reserve(std::size_t size) {
+    precondition()([](auto wanted_size,
+                      auto page_size) { return wanted_size % page_size == 0; },
+                   size,
+                   _page_size);
+
+    void* memory = mmap(nullptr,
+                        size,
+                        PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                        -1,
+                        0);
+    if (memory == MAP_FAILED) throw std::bad_alloc{};
+
+#ifdef HAVEN_DBG_PAGE_TRACE
+    _allocated.push_back(memory);
+    _count++;
+#endif
+
+    postcondition()([](auto mem) { return mem != nullptr; }, memory);
+    return {memory, size};
+}
+
+hvn::page_allocator::committed_page
+hvn::page_allocator::commit(page_allocator::allocated_page page) {
+    precondition()([](auto page) { return page.base_addr() != nullptr; },
+                   page);
+    precondition()([](auto wanted_size,
+                      auto page_size) { return wanted_size % page_size == 0; },
+                   page.size(),
+                   _page_size);
+
+    auto succ = mprotect(page.base_addr(),
+                         page.size(),
+                         PROT_READ | PROT_WRITE);
+    if (succ != 0) throw std::bad_alloc{};
+
+    trace(trace_event::page_commit, trace_phase::instant, static_cast<std::uint32_t>(page.size() / _page_size));
+    return {static_cast<std::byte*>(page.base_addr()), page.size()};
+}
+
+hvn::page_allocator::committed_page
+hvn::page_allocator::commit(page_allocator::loaned_page page) {
+    precondition()([](auto addr) { return addr != nullptr; }, page.base_addr());
+    precondition()([](auto size) { return size != 0; }, page.size());
+
+    trace(trace_event::page_commit, trace_phase::instant, static_cast<std::uint32_t>(page.size() / _page_size));
+    // loaned pages stay mapped read-write, the kernel may just have replaced
+    // their contents with zero pages in the meantime
+    return {static_cast<std::byte*>(page.base_addr()), page.size()};
+}
+
+hvn::page_allocator::allocated_page
+hvn::page_allocator::decommit(page_allocator::committed_page page) {
+    precondition()([](auto addr) { return addr != nullptr; }, page.base_addr());
+    precondition()([](auto size) { return size > 0; }, page.size());
+
+    madvise(page.base_addr(),
+            page.size(),
+            MADV_DONTNEED);
+    mprotect(page.base_addr(),
+             page.size(),
+             PROT_NONE);
+
+    trace(trace_event::page_decommit, trace_phase::instant, static_cast<std::uint32_t>(page.size() / _page_size));
+    return {page.base_addr(), page.size()};
+}
+
+namespace {
+    using namespace hvn::literals;
+    void
+    decommit_release(void* addr,
+                     std::size_t size) {
+        precondition()([](auto addr) { return addr != nullptr; }, addr);
+        precondition()([](auto size) { return size > 0; }, size);
+
+        auto succ = munmap(addr, size);
+
+        postcondition()(
+               "could not succeed with munmap"_msg,
+               [](int succ, auto...) { return succ == 0; },
+               succ,
+               addr,
+               errno);
+    }
+
+    [[maybe_unused]] void
+    decommit_release(void* addr,
+                     std::size_t size,
+                     std::vector<const void*>& alloc) {
+        precondition()([&alloc, &addr] {
+            return std::ranges::any_of(alloc, [&addr](auto elem) { return elem == addr; });
+        });
+
+        decommit_release(addr, size);
+        std::erase(alloc, addr);
+
+        postcondition()([&alloc, &addr] {
+            return std::ranges::none_of(alloc, [&addr](auto elem) { return elem == addr; });
+        });
+    }
+}
+
+#ifdef HAVEN_DBG_PAGE_TRACE
+#  define ALLOCATED_PARAM , _allocated
+#else
+#  define ALLOCATED_PARAM
+#endif
+
+void
+hvn::page_allocator::deallocate(page_allocator::committed_page page) {
+    decommit_release(page.base_addr(),
+                     page.size()
+                            ALLOCATED_PARAM);
+}
+
+void
+hvn::page_allocator::deallocate(page_allocator::allocated_page page) {
+    decommit_release(page.base_addr(),
+                     page.size()
+                            ALLOCATED_PARAM);
+}
+
+void
+hvn::page_allocator::deallocate(page_allocator::loaned_page page) {
+    decommit_release(page.base_addr(),
+                     page.size()
+                            ALLOCATED_PARAM);
+}
+#undef ALLOCATED_PARAM
+
+hvn::page_allocator::committed_page
+hvn::page_allocator::allocate(std::size_t size) {
+    assert(size % _page_size == 0);
+
+    void* memory = mmap(nullptr,
+                        size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1,
+                        0);
+    if (memory == MAP_FAILED) throw std::bad_alloc{};
+
+#ifdef HAVEN_DBG_PAGE_TRACE
+    _allocated.push_back(memory);
+    _count++;
+#endif
+
+    return {static_cast<std::byte*>(memory), size};
+}
+
+std::size_t
+hvn::page_allocator::approx_cache_line1() {
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+    auto line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (line > 0) [[likely]] return static_cast<std::size_t>(line);
+#endif
+    return std::size_t{64}; // approx.
+}
+
+std::variant<hvn::page_allocator::loaned_page,
+             hvn::page_allocator::allocated_page>
+hvn::page_allocator::loan(page_allocator::allocated_page page) {
+    return page;
+}
+
+void
+hvn::page_allocator::prefault(page_allocator::committed_page page) const {
+#ifdef MADV_POPULATE_WRITE
+    // one syscall instead of a fault per page, since Linux 5.14
+    if (madvise(page.base_addr(), page.size(), MADV_POPULATE_WRITE) == 0) return;
+#endif
+    touch_pages(page.base_addr(), page.size(), _page_size);
+}
+
+std::variant<hvn::page_allocator::loaned_page,
+             hvn::page_allocator::committed_page>
+hvn::page_allocator::loan(page_allocator::committed_page page) {
+#ifdef MADV_FREE
+    auto succ = madvise(page.base_addr(),
+                        page.size(),
+                        MADV_FREE);
+    if (succ != 0)
+        return page;
+
+    trace(trace_event::page_loan, trace_phase::instant, static_cast<std::uint32_t>(page.size() / _page_size));
+    return loaned_page{page.base_addr(), page.size()};
+#else
+    return page;
+#endif
+}
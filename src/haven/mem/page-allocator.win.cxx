@@ -22,6 +22,7 @@
 #include <windows.h>
 
 #include "../common/check_conditions.hxx"
+#include "../common/trace.hxx"
 
 std::size_t
 hvn::page_allocator::figure_out_page_size() noexcept {
@@ -72,6 +73,7 @@ hvn::page_allocator::commit(page_allocator::allocated_page page) {
 
     postcondition()([](auto mem) { return mem != nullptr; }, memory);
     postcondition()([&page](auto mem) { return mem == page.base_addr(); }, memory);
+    trace(trace_event::page_commit, trace_phase::instant, static_cast<std::uint32_t>(page.size() / _page_size));
     return {static_cast<std::byte*>(memory), page.size()};
 }
 
@@ -84,6 +86,7 @@ hvn::page_allocator::decommit(page_allocator::committed_page page) {
                 page.size(),
                 MEM_DECOMMIT);
 
+    trace(trace_event::page_decommit, trace_phase::instant, static_cast<std::uint32_t>(page.size() / _page_size));
     return {page.base_addr(), page.size()};
 }
 
@@ -186,3 +189,10 @@ hvn::page_allocator::deallocate(hvn::page_allocator::loaned_page page) {
 
     deallocate(commit(page));
 }
+
+void
+hvn::page_allocator::prefault(hvn::page_allocator::committed_page page) const {
+    // PrefetchVirtualMemory only reads in pages backed by files, fresh memory
+    // needs to be written to
+    touch_pages(page.base_addr(), page.size(), _page_size);
+}
@@ -22,6 +22,7 @@
 #include <windows.h>
 
 #include "../common/check_conditions.hxx"
+#include "../common/trace.hxx"
 
 hvn::page_allocator::committed_page
 hvn::page_allocator::commit(page_allocator::loaned_page page) {
@@ -40,6 +41,7 @@ hvn::page_allocator::commit(page_allocator::loaned_page page) {
         throw std::bad_alloc{};
     }
 
+    trace(trace_event::page_commit, trace_phase::instant, static_cast<std::uint32_t>(page.size() / _page_size));
     return {static_cast<std::byte*>(page.base_addr()), page.size()};
 }
 
@@ -53,6 +55,7 @@ hvn::page_allocator::loan(page_allocator::allocated_page page) {
     if (succ != ERROR_SUCCESS)
         return page;
 
+    trace(trace_event::page_loan, trace_phase::instant, static_cast<std::uint32_t>(page.size() / _page_size));
     return loaned_page{page.base_addr(), page.size()};
 }
 
@@ -65,5 +68,6 @@ hvn::page_allocator::loan(page_allocator::committed_page page) {
     if (succ != ERROR_SUCCESS)
         return page;
 
+    trace(trace_event::page_loan, trace_phase::instant, static_cast<std::uint32_t>(page.size() / _page_size));
     return loaned_page{page.base_addr(), page.size()};
 }
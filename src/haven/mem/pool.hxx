@@ -11,63 +11,350 @@
 #define LIBHAVEN_MX_POOL_HXX
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstdint>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+#include <haven/common/trace.hxx>
 #include <haven/mem/page-allocator.hxx>
 #include <haven/mem/puddle.hxx>
+#include <haven/mem/slot-layout.hxx>
 
 namespace hvn {
+    // A compact reference to an object allocated in a pool: the index of the
+    // puddle and of the slot in it, optionally tagged with the generation of
+    // the slot. Only meaningful to the pool that issued it.
+    struct pool_handle {
+        constexpr const static auto null_value = std::uint32_t(-1);
+
+        constexpr pool_handle() noexcept = default;
+        constexpr explicit pool_handle(std::uint32_t value) noexcept
+             : _value(value) { }
+
+        [[nodiscard]] constexpr std::uint32_t
+        value() const noexcept { return _value; }
+
+        [[nodiscard]] constexpr bool
+        is_null() const noexcept { return _value == null_value; }
+
+        constexpr explicit
+        operator bool() const noexcept { return !is_null(); }
+
+        friend constexpr bool
+        operator==(pool_handle, pool_handle) noexcept = default;
+
+    private:
+        std::uint32_t _value = null_value;
+    };
+    static_assert(sizeof(pool_handle) == sizeof(std::uint32_t));
+
     template<class T,
-             allocator Allocator = page_allocator>
+             allocator Allocator = page_allocator,
+             slot_layout Layout = packed_layout,
+             std::size_t GenerationBits = 0>
     struct pool {
+        static_assert(GenerationBits <= 8, "generation tags are stored in a byte per slot");
+
+        using value_type = T;
+        using allocator_type = Allocator;
+        using layout_type = Layout;
+        using puddle_type = puddle<T, Allocator, Layout>;
+        using handle_type = pool_handle;
+
+        pool()
+            requires(std::default_initializable<allocator_type>) {
+            init();
+        }
+
+        // constructs the pool's allocator from the given arguments
+        template<class... AllocatorArgs>
+        explicit pool(std::in_place_t, AllocatorArgs&&... args)
+             : _allocator(std::forward<AllocatorArgs>(args)...) {
+            init();
+        }
+
+        pool(const pool&) = delete;
+        pool&
+        operator=(const pool&) = delete;
+
+        ~pool() noexcept {
+            for (auto& segment : _segments) {
+                delete[] segment.load(std::memory_order_relaxed);
+            }
+        }
+
+        // creates and commits puddles up front, so count objects fit into the
+        // pool without growing it, or committing memory on allocation
+        void
+        reserve(std::size_t count, page_prefault prefault = page_prefault::lazy) {
+            auto per_puddle = at(0).puddle->capacity();
+            auto puddles = std::max(std::size_t{1}, (count + per_puddle - 1) / per_puddle);
+
+            for (auto seen = puddle_count(); seen < puddles; seen = puddle_count()) {
+                add_puddle(seen);
+            }
+            for (std::size_t i = 0; i < puddles; ++i) {
+                at(i).puddle->warm_up(prefault);
+            }
+        }
+
+        [[nodiscard]] std::size_t
+        capacity() const noexcept {
+            return puddle_count() * at(0).puddle->capacity();
+        }
+
+        [[nodiscard]] std::size_t
+        puddle_count() const noexcept {
+            return _puddle_count.load(std::memory_order_acquire);
+        }
+
         template<class... Args>
         [[nodiscard]] T*
         allocate(Args&&... args) {
+            return allocate_in(std::forward<Args>(args)...).first;
+        }
+
+        template<class... Args>
+        [[nodiscard]] handle_type
+        allocate_handle(Args&&... args) {
+            auto [ret, idx] = allocate_in(std::forward<Args>(args)...);
+            if (idx > max_puddle_index()) {
+                deallocate(ret);
+                throw std::bad_alloc{};
+            }
+
+            auto& entry = at(idx);
+            auto slot = entry.puddle->slot_index(ret);
+            return make_handle(idx, slot, generation_of(entry, slot));
+        }
+
+        // resolves the handle to the object in O(1)
+        // if generation tags are enabled, stale handles resolve to null
+        [[nodiscard]] T*
+        resolve(handle_type handle) const noexcept {
+            if (handle.is_null()) return nullptr;
+
+            auto [idx, slot, gen] = split_handle(handle);
+            if (idx >= _puddle_count.load(std::memory_order_acquire)) return nullptr;
+
+            auto& entry = at(idx);
+            if (slot >= entry.puddle->capacity()) return nullptr;
+            if (gen != generation_of(entry, slot)) return nullptr;
+            return entry.puddle->slot_address(slot);
+        }
+
+        void
+        deallocate(T* mem) {
+            auto count = _puddle_count.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < count; ++i) {
+                auto& entry = at(i);
+                if (!entry.puddle->owns(mem)) continue;
+                // only the searches going past the first puddle are worth noting
+                if (i > 0) trace(trace_event::pool_deallocate_scan, trace_phase::instant, static_cast<std::uint32_t>(i));
+                deallocate_in(i, mem);
+                return;
+            }
+        }
+
+        // calls fn with every object allocated from the pool, and not yet
+        // deallocated; fn may deallocate the object it is called with, but
+        // nothing else may allocate or deallocate meanwhile
+        template<class Fn>
+            requires std::invocable<Fn&, T*>
+        void
+        for_each_allocated(Fn&& fn) {
+            auto count = _puddle_count.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < count; ++i) {
+                auto& puddle = *at(i).puddle;
+                for (std::size_t slot = 0; slot < puddle.capacity(); ++slot) {
+                    if (puddle.slot_in_use(slot)) fn(puddle.slot_address(slot));
+                }
+            }
+        }
+
+        // returns false if the handle is stale or null
+        bool
+        deallocate(handle_type handle) {
+            auto ptr = resolve(handle);
+            if (ptr == nullptr) return false;
+
+            deallocate_in(std::get<0>(split_handle(handle)), ptr);
+            return true;
+        }
+
+    private:
+        void
+        init() {
+            add_puddle(0);
+
+            auto capacity = at(0).puddle->capacity();
+            _slot_bits = static_cast<std::size_t>(std::bit_width(capacity - 1));
+            postcondition()("handles have room for puddle indices"_msg,
+                            [](auto slot_bits) { return slot_bits + GenerationBits < 32; },
+                            _slot_bits);
+        }
+
+        constexpr const static auto slot_used = std::uint_fast8_t{0};
+        constexpr const static auto slot_empty = std::uint_fast8_t{0xFF};
+        constexpr const static auto generation_mask = static_cast<std::uint8_t>((1u << GenerationBits) - 1);
+        using ctrl_type = std::vector<std::uint_fast8_t>; // maybe simd-ify, prolly not though
+
+        struct directory_entry {
+            std::unique_ptr<puddle_type> puddle;
+            std::unique_ptr<std::atomic<std::uint8_t>[]> generations;
+        };
+
+        // the puddles are stored in segments of growing size, 1, 2, 4, ...
+        // entries never move, so they can be accessed without holding _ctrl_mx
+        constexpr const static auto directory_segments = std::size_t{32};
+
+        static std::pair<std::size_t, std::size_t>
+        locate(std::size_t idx) noexcept {
+            auto segment = static_cast<std::size_t>(std::bit_width(idx + 1)) - 1;
+            return {segment, idx + 1 - (std::size_t{1} << segment)};
+        }
+
+        directory_entry&
+        at(std::size_t idx) const noexcept {
+            auto [segment, offset] = locate(idx);
+            return _segments[segment].load(std::memory_order_acquire)[offset];
+        }
+
+        // adds a puddle after the first seen ones, unless another thread
+        // already has; growers take turns on _grow_mx, as the allocator is
+        // not shared safely, and allocate without holding _ctrl_mx, which is
+        // only taken to link the new puddle in
+        void
+        add_puddle(std::size_t seen) {
+            trace_scope scope(trace_event::pool_add_puddle, static_cast<std::uint32_t>(seen));
+            std::scoped_lock grow_lck(_grow_mx);
+            if (_puddle_count.load(std::memory_order_relaxed) != seen) return;
+            auto [segment, offset] = locate(seen);
+            precondition()([](auto segment) { return segment < directory_segments; }, segment);
+
+            auto puddle = std::make_unique<puddle_type>(&_allocator);
+            std::unique_ptr<std::atomic<std::uint8_t>[]> generations;
+            if constexpr (GenerationBits > 0) {
+                generations = std::make_unique<std::atomic<std::uint8_t>[]>(puddle->capacity());
+            }
+            // the first puddle of a segment brings the segment, and ctrl bytes
+            // for all puddles up to the end of it
+            std::unique_ptr<directory_entry[]> entries;
+            ctrl_type ctrl;
+            if (offset == 0) {
+                entries = std::make_unique<directory_entry[]>(std::size_t{1} << segment);
+                ctrl.reserve((std::size_t{2} << segment) - 1);
+            }
+
+            std::scoped_lock lck(_ctrl_mx);
+            if (entries) {
+                _segments[segment].store(entries.release(), std::memory_order_release);
+                ctrl.assign(_ctrl.begin(), _ctrl.end());
+                std::swap(_ctrl, ctrl);
+            }
+            auto& entry = _segments[segment].load(std::memory_order_relaxed)[offset];
+            entry.puddle = std::move(puddle);
+            entry.generations = std::move(generations);
+            _ctrl.push_back(slot_empty);
+            _puddle_count.store(seen + 1, std::memory_order_release);
+        }
+
+        template<class... Args>
+        std::pair<T*, std::size_t>
+        allocate_in(Args&&... args) {
             T* ret = nullptr;
             std::size_t idx;
             while (ret == nullptr) {
+                std::size_t seen = 0; // the puddles found full, if any
                 {
                     std::scoped_lock lck(_ctrl_mx);
                     auto empty = std::ranges::find(_ctrl, slot_empty);
-                    idx = std::distance(_ctrl.begin(), empty);
                     if (empty == _ctrl.end()) {
-                        _puddles.emplace_back();
-                        _ctrl.push_back(slot_used);
-                        idx = _puddles.size() - 1;
-                        empty = _ctrl.begin() + (_ctrl.size() - 1);
+                        seen = _ctrl.size();
                     }
-                    *empty = slot_used;
+                    else {
+                        idx = std::distance(_ctrl.begin(), empty);
+                        *empty = slot_used;
+                    }
+                }
+                if (seen > 0) {
+                    add_puddle(seen);
+                    continue;
+                }
+                ret = at(idx).puddle->try_allocate(std::forward<Args>(args)...);
+                if (ret != nullptr) {
+                    // the puddle may still have room, let others try it
+                    std::scoped_lock lck(_ctrl_mx);
+                    _ctrl[idx] = slot_empty;
                 }
-                ret = _puddles[idx]->try_allocate(std::forward<Args>(args)...);
             }
-            for (std::size_t i = 0; i < _puddles.size(); ++i) {
-                if (i != idx) _puddles[i]->unused_in_allocation();
+            auto count = _puddle_count.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < count; ++i) {
+                if (i != idx) at(i).puddle->unused_in_allocation();
             }
-            return ret;
+            return {ret, idx};
         }
 
         void
-        deallocate(T* mem) {
-            for (std::size_t i = 0; i < _puddles.size(); ++i) {
-                if (_puddles[i]->deallocate(mem)) {
-                    std::scoped_lock lck(_ctrl_mx);
-                    _ctrl[i] = slot_empty;
-                    return;
-                }
+        deallocate_in(std::size_t idx, T* mem) {
+            auto& entry = at(idx);
+            if constexpr (GenerationBits > 0) {
+                entry.generations[entry.puddle->slot_index(mem)].fetch_add(1, std::memory_order_relaxed);
             }
+            std::ignore = entry.puddle->deallocate(mem);
+
+            std::scoped_lock lck(_ctrl_mx);
+            _ctrl[idx] = slot_empty;
         }
 
-    private:
-        constexpr const static auto slot_used = std::uint_fast8_t{0};
-        constexpr const static auto slot_empty = std::uint_fast8_t{0xFF};
-        using ctrl_type = std::vector<std::uint_fast8_t>; // maybe simd-ify, prolly not though
+        static std::uint8_t
+        generation_of(const directory_entry& entry, std::size_t slot) noexcept {
+            if constexpr (GenerationBits > 0) {
+                return entry.generations[slot].load(std::memory_order_relaxed) & generation_mask;
+            }
+            else {
+                return 0;
+            }
+        }
+
+        [[nodiscard]] std::size_t
+        max_puddle_index() const noexcept {
+            // the all-ones pattern is reserved for the null handle
+            return (std::size_t{1} << (32 - _slot_bits - GenerationBits)) - 2;
+        }
+
+        [[nodiscard]] handle_type
+        make_handle(std::size_t idx, std::size_t slot, std::uint8_t gen) const noexcept {
+            auto value = (idx << (_slot_bits + GenerationBits))
+                         | (slot << GenerationBits)
+                         | gen;
+            return handle_type{static_cast<std::uint32_t>(value)};
+        }
+
+        [[nodiscard]] std::tuple<std::size_t, std::size_t, std::uint8_t>
+        split_handle(handle_type handle) const noexcept {
+            auto value = std::size_t{handle.value()};
+            return {value >> (_slot_bits + GenerationBits),
+                    (value >> GenerationBits) & ((std::size_t{1} << _slot_bits) - 1),
+                    static_cast<std::uint8_t>(value & generation_mask)};
+        }
 
-        ctrl_type _ctrl = ctrl_type(1, slot_empty);
+        allocator_type _allocator{};
+        ctrl_type _ctrl{};
         std::mutex _ctrl_mx;
+        std::mutex _grow_mx;
 
-        std::vector<std::unique_ptr<puddle<T, Allocator>>> _puddles{std::make_unique<puddle<T, Allocator>>()};
+        std::array<std::atomic<directory_entry*>, directory_segments> _segments{};
+        std::atomic<std::size_t> _puddle_count{};
+        std::size_t _slot_bits{};
     };
 }
 
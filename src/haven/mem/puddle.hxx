@@ -15,23 +15,30 @@
 #include <variant>
 
 #include <haven/common/check_conditions.hxx>
+#include <haven/common/trace.hxx>
 #include <haven/mem/page-allocator.hxx>
-#include <xsimd/xsimd.hpp>
+#include <haven/mem/slot-ctrl.hxx>
+#include <haven/mem/slot-layout.hxx>
 
 namespace hvn {
     template<class T,
-             allocator Allocator = page_allocator>
+             allocator Allocator = page_allocator,
+             slot_layout Layout = packed_layout>
     struct puddle {
-        static_assert(sizeof(T) >= alignof(T),
-                      "Trivial implementation reasons");
         using value_type = T;
         using allocator_type = Allocator;
+        using layout_type = Layout;
 
         puddle(allocator_type* allocator)
              : _allocator(allocator),
-               _ctrl(_allocator->page_size() / sizeof(T), slot_empty),
-               _state(_allocator->reserve(_allocator->page_size())) {
-            postcondition()([](auto size) { return size > 0; }, _allocator->page_size() / sizeof(T));
+               _stride(Layout::template stride<T>(_allocator->approx_cache_line1())),
+               _ctrl(slot_span_size(_stride, _allocator->page_size()) / _stride),
+               _state(_allocator->reserve(slot_span_size(_stride, _allocator->page_size()))) {
+            precondition()("over-alignment is at most the page size"_msg,
+                           [](auto page_size) { return alignof(T) <= page_size; },
+                           _allocator->page_size());
+            postcondition()([](auto stride) { return stride % alignof(T) == 0; }, _stride);
+            postcondition()([](auto size) { return size > 0; }, _ctrl.size());
             postcondition()([this](auto) { return !valid_memory(); }, _state.index());
         }
 
@@ -40,6 +47,22 @@ namespace hvn {
             return _ctrl.size();
         }
 
+        [[nodiscard]] std::size_t
+        stride() const noexcept {
+            return _stride;
+        }
+
+        // commits the page ahead of the first allocation, and optionally
+        // faults it in, so allocating does not have to pay for either
+        void
+        warm_up(page_prefault prefault = page_prefault::lazy) {
+            std::scoped_lock lck(_puddle_mx);
+            if (!valid_memory()) retake_buffer();
+            if (prefault == page_prefault::populate) {
+                hvn::prefault(*_allocator, std::get<typename allocator_type::committed_page>(_state));
+            }
+        }
+
         void
         unused_in_allocation() {
             std::scoped_lock lck(_puddle_mx);
@@ -55,16 +78,18 @@ namespace hvn {
                 std::scoped_lock lck(_puddle_mx);
 
                 inc_use();
-                idx = find_empty();
+                idx = _ctrl.claim_empty();
 
                 postcondition()([this](auto) { return valid_memory(); }, _state.index());
                 postcondition()([](auto use) { return use > 0; }, _use);
 
-                if (idx == std::size_t(-1)) return nullptr;
+                if (idx == slot_ctrl::npos) return nullptr;
+#ifdef HAVEN_DBG_PUDDLE_TRACE
                 ++_allocated_count;
+#endif
             }
             auto& page = std::get<typename allocator_type::committed_page>(_state);
-            ret = std::construct_at(reinterpret_cast<T*>(page.base_addr()) + idx, std::forward<Args>(args)...);
+            ret = std::construct_at(reinterpret_cast<T*>(page.base_addr() + idx * _stride), std::forward<Args>(args)...);
 
             // clang-format off
             postcondition()("ret is either null or in the page"_msg,
@@ -78,26 +103,51 @@ namespace hvn {
         [[nodiscard]] bool
         deallocate(T* ptr) {
             if (ptr == nullptr) return true;
+            if (!owns(ptr)) return false;
             precondition()([this] { return valid_memory(); });
 
-            auto& page = std::get<typename allocator_type::committed_page>(_state);
-            if (!(page.base_addr() <= reinterpret_cast<std::byte*>(ptr)
-                  && reinterpret_cast<std::byte*>(ptr) < page.base_addr() + page.size())) return false;
-
             std::destroy_at(ptr);
-            auto idx = std::distance(reinterpret_cast<T*>(page.base_addr()), ptr);
+            auto idx = slot_index(ptr);
             {
                 std::scoped_lock lck(_puddle_mx);
-                _ctrl[idx] = slot_empty;
+                _ctrl.release(idx);
+#ifdef HAVEN_DBG_PUDDLE_TRACE
                 ++_deallocated_count;
+#endif
 
-                postcondition()([](auto slot) { return slot == slot_empty; }, _ctrl[idx]);
+                postcondition()([](auto slot) { return slot == slot_ctrl::slot_empty; }, _ctrl[idx]);
             }
 
             postcondition()([this] { return valid_memory(); });
             return true;
         }
 
+        [[nodiscard]] bool
+        owns(const T* ptr) const noexcept {
+            auto addr = reinterpret_cast<const std::byte*>(ptr);
+            return base_addr() <= addr && addr < base_addr() + _ctrl.size() * _stride;
+        }
+
+        [[nodiscard]] std::size_t
+        slot_index(const T* ptr) const noexcept {
+            precondition()([this](auto ptr) { return owns(ptr); }, ptr);
+            return static_cast<std::size_t>(reinterpret_cast<const std::byte*>(ptr) - base_addr()) / _stride;
+        }
+
+        [[nodiscard]] bool
+        slot_in_use(std::size_t idx) {
+            precondition()([this](auto idx) { return idx < capacity(); }, idx);
+            std::scoped_lock lck(_puddle_mx);
+            return _ctrl.is_used(idx);
+        }
+
+        // the address of the slot, regardless of whether it is in use
+        [[nodiscard]] T*
+        slot_address(std::size_t idx) const noexcept {
+            precondition()([this](auto idx) { return idx < capacity(); }, idx);
+            return reinterpret_cast<T*>(base_addr() + idx * _stride);
+        }
+
         ~puddle() noexcept {
 #ifdef HAVEN_DBG_PUDDLE_TRACE
             try {
@@ -112,12 +162,12 @@ namespace hvn {
                        },
                        _state);
                 for (std::size_t i = 0; i < _ctrl.size(); ++i) {
-                    if (_ctrl[i] == slot_used) {
+                    if (_ctrl.is_used(i)) {
                         if (good) {
                             ostr << "\t!! the elements at the following memory addresses have not been deallocated !!\n";
                             good = false;
                         }
-                        ostr << "\t\t- " << base_addr + sizeof(T) * i << "\n";
+                        ostr << "\t\t- " << base_addr + _stride * i << "\n";
                     }
                 }
                 if (good) {
@@ -135,16 +185,9 @@ namespace hvn {
         }
 
     private:
-        constexpr const static auto slot_used = std::uint_fast8_t{0};
-        constexpr const static auto slot_empty = std::uint_fast8_t{0xFF};
-        struct is_used_slot {
-            constexpr auto
-            operator()(auto elem) const noexcept {
-                return elem == slot_used;
-            }
-        };
-
-        using ctrl_type = std::vector<std::uint_fast8_t, xsimd::default_allocator<std::uint_fast8_t>>;
+        using state_type = std::variant<typename allocator_type::allocated_page,
+                                        typename allocator_type::committed_page,
+                                        typename allocator_type::loaned_page>;
 
         void
         inc_use() {
@@ -170,6 +213,9 @@ namespace hvn {
 
         void
         retake_buffer() {
+            // the page may be in use by other threads, do not even rewrite it
+            if (valid_memory()) return;
+            trace(trace_event::puddle_retake_buffer);
             _state = std::visit(
                    [&_allocator = *_allocator](const auto& page) {
                        return _allocator.commit(page);
@@ -183,14 +229,22 @@ namespace hvn {
         give_up_buffer() {
             precondition()([this](auto) { return valid_memory(); }, _state.index());
 
-            if (std::ranges::any_of(_ctrl, is_used_slot{})) return;
+            if (_ctrl.any_used()) return;
+            trace(trace_event::puddle_give_up_buffer);
+            // the allocator may refuse the loan and hand the committed page back
             _state = std::visit(
-                   [&_allocator = *_allocator](const auto& page) {
-                       return _allocator.loan(page);
+                   [](const auto& page) -> state_type {
+                       return page;
                    },
-                   _state);
+                   _allocator->loan(std::get<typename allocator_type::committed_page>(_state)));
+        }
 
-            postcondition()([this](auto) { return !valid_memory(); }, _state.index());
+        // the page keeps its address in every state, so it is read from the
+        // state only once, and not racing with the state changing under
+        // _puddle_mx
+        std::byte*
+        base_addr() const noexcept {
+            return _base_addr;
         }
 
         bool
@@ -198,47 +252,17 @@ namespace hvn {
             return std::holds_alternative<typename Allocator::committed_page>(_state);
         }
 
-        std::size_t
-        find_empty() {
-            namespace xs = xsimd;
-            using batch_type = xs::batch<std::uint_fast8_t>;
-            auto empty = batch_type ::broadcast(slot_empty);
-
-            auto simd_size = batch_type ::size;
-            auto ctrl_size = _ctrl.size();
-            auto vectorized_size = ctrl_size - ctrl_size % simd_size;
-
-            for (std::size_t i = 0; i < vectorized_size; i += simd_size) {
-                auto batch = batch_type ::load_aligned(&_ctrl[i]);
-                auto bools = batch == empty;
-                auto has_empty = xs::any(bools);
-                if (has_empty) {
-                    auto found = std::ranges::find(&_ctrl[i], &_ctrl[i] + simd_size, slot_empty);
-                    *found = slot_used;
-                    return std::distance(&_ctrl[0], found);
-                }
-            }
-
-            if (vectorized_size != ctrl_size) {
-                auto found = std::ranges::find(&_ctrl[vectorized_size],
-                                               _ctrl.data() + ctrl_size,
-                                               std::uint_fast8_t{0});
-                if (found != _ctrl.data() + ctrl_size) {
-                    *found = slot_used;
-                    return std::distance(&_ctrl[0], found);
-                }
-            }
-            return std::size_t(-1);
-        }
-
         std::uint8_t _use = 0b000u;
         std::mutex _puddle_mx{};
         allocator_type* _allocator;
-        ctrl_type _ctrl;
-        std::variant<typename allocator_type::allocated_page,
-                     typename allocator_type::committed_page,
-                     typename allocator_type::loaned_page>
-               _state;
+        std::size_t _stride;
+        slot_ctrl _ctrl;
+        state_type _state;
+        std::byte* _base_addr = std::visit(
+               [](const auto& page) {
+                   return static_cast<std::byte*>(page.base_addr());
+               },
+               _state);
 #ifdef HAVEN_DBG_PUDDLE_TRACE
         std::size_t _allocated_count{};
         std::size_t _deallocated_count{};
@@ -0,0 +1,89 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-22.
+ *
+ * src/haven/mem/slot-ctrl --
+ *   The control block of puddles: one byte per slot, telling whether the slot
+ *   is in use or empty. Searching for an empty slot is vectorized with xsimd.
+ *   Does not synchronize, it is the owning puddle's responsibility.
+ */
+#ifndef LIBHAVEN_SLOT_CTRL_HXX
+#define LIBHAVEN_SLOT_CTRL_HXX
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <xsimd/xsimd.hpp>
+
+namespace hvn {
+    struct slot_ctrl {
+        constexpr const static auto slot_used = std::uint_fast8_t{0};
+        constexpr const static auto slot_empty = std::uint_fast8_t{0xFF};
+        constexpr const static auto npos = std::size_t(-1);
+
+        explicit slot_ctrl(std::size_t size)
+             : _slots(size, slot_empty) { }
+
+        [[nodiscard]] std::size_t
+        size() const noexcept { return _slots.size(); }
+
+        [[nodiscard]] std::uint_fast8_t
+        operator[](std::size_t idx) const noexcept { return _slots[idx]; }
+
+        [[nodiscard]] bool
+        is_used(std::size_t idx) const noexcept { return _slots[idx] == slot_used; }
+
+        [[nodiscard]] bool
+        any_used() const noexcept {
+            return std::ranges::any_of(_slots, [](auto elem) { return elem == slot_used; });
+        }
+
+        void
+        release(std::size_t idx) noexcept { _slots[idx] = slot_empty; }
+
+        // finds an empty slot, marks it used, and returns its index
+        // if there are no empty slots, returns npos
+        [[nodiscard]] std::size_t
+        claim_empty() noexcept {
+            namespace xs = xsimd;
+            using batch_type = xs::batch<std::uint_fast8_t>;
+            auto empty = batch_type ::broadcast(slot_empty);
+
+            auto simd_size = batch_type ::size;
+            auto ctrl_size = _slots.size();
+            auto vectorized_size = ctrl_size - ctrl_size % simd_size;
+
+            for (std::size_t i = 0; i < vectorized_size; i += simd_size) {
+                auto batch = batch_type ::load_aligned(&_slots[i]);
+                auto bools = batch == empty;
+                auto has_empty = xs::any(bools);
+                if (has_empty) {
+                    auto found = std::ranges::find(&_slots[i], &_slots[i] + simd_size, slot_empty);
+                    *found = slot_used;
+                    return std::distance(&_slots[0], found);
+                }
+            }
+
+            if (vectorized_size != ctrl_size) {
+                auto found = std::ranges::find(&_slots[vectorized_size],
+                                               _slots.data() + ctrl_size,
+                                               slot_empty);
+                if (found != _slots.data() + ctrl_size) {
+                    *found = slot_used;
+                    return std::distance(&_slots[0], found);
+                }
+            }
+            return npos;
+        }
+
+    private:
+        std::vector<std::uint_fast8_t, xsimd::default_allocator<std::uint_fast8_t>> _slots;
+    };
+}
+
+#endif
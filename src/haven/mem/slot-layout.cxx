@@ -0,0 +1,13 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-21.
+ *
+ * src/haven/mem/slot-layout --
+ *   Source file for the slot layout policies.
+ *   Used to ensure clean inclusion.
+ */
+
+#include "slot-layout.hxx"
@@ -0,0 +1,61 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-21.
+ *
+ * src/haven/mem/slot-layout --
+ *   Layout policies deciding how the slots of a puddle are placed in its page.
+ *   A policy provides the distance between two consecutive slots, the stride,
+ *   calculated from the stored type and the L1 cache line size reported by
+ *   the allocator.
+ */
+#ifndef LIBHAVEN_SLOT_LAYOUT_HXX
+#define LIBHAVEN_SLOT_LAYOUT_HXX
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+
+namespace hvn {
+    template<class L>
+    concept slot_layout =
+           requires(std::size_t cache_line) {
+               { L::template stride<std::max_align_t>(cache_line) } -> std::same_as<std::size_t>;
+           };
+
+    // Places objects back to back, as an array of T would.
+    // Objects written by different threads may share a cache line.
+    struct packed_layout {
+        template<class T>
+        [[nodiscard]] static constexpr std::size_t
+        stride(std::size_t /*cache_line*/) noexcept {
+            return sizeof(T);
+        }
+    };
+
+    // Pads every slot to a multiple of the cache line size, so no two objects
+    // ever share a cache line. Prevents false sharing between objects written
+    // concurrently by different threads, at the cost of capacity.
+    struct cache_line_layout {
+        template<class T>
+        [[nodiscard]] static constexpr std::size_t
+        stride(std::size_t cache_line) noexcept {
+            auto align = std::max(alignof(T), cache_line);
+            return (sizeof(T) + align - 1) / align * align;
+        }
+    };
+
+    // a puddle spans a single page, unless one slot does not fit into it,
+    // then as many pages as are needed for exactly one slot
+    [[nodiscard]] constexpr std::size_t
+    slot_span_size(std::size_t stride, std::size_t page_size) noexcept {
+        return std::max(page_size, (stride + page_size - 1) / page_size * page_size);
+    }
+
+    static_assert(slot_layout<packed_layout>, "hvn::packed_layout needs to be a hvn::slot_layout");
+    static_assert(slot_layout<cache_line_layout>, "hvn::cache_line_layout needs to be a hvn::slot_layout");
+}
+
+#endif
@@ -0,0 +1,134 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-28.
+ *
+ * test/common/trace --
+ *   Test suite for the event tracing.
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/common/trace.hxx>
+
+using namespace boost::ut;
+
+#ifdef HAVEN_TRACE_EVENTS
+namespace {
+    // restarts tracing with a clean slate, and switches it off afterwards
+    struct tracing {
+        tracing() {
+            hvn::trace_clear();
+            hvn::trace_enable(true);
+        }
+
+        ~tracing() {
+            hvn::trace_enable(false);
+        }
+    };
+
+    auto
+    count_of(const std::vector<hvn::trace_record>& records, hvn::trace_event event) {
+        return std::ranges::count(records, event, &hvn::trace_record::event);
+    }
+}
+
+[[maybe_unused]] const suite trace_suite = [] {
+    "nothing is recorded while tracing is off"_test = [] {
+        hvn::trace_clear();
+        hvn::trace(hvn::trace_event::job_enqueue);
+        expect(hvn::trace_snapshot().empty());
+    };
+
+    "events are recorded in order"_test = [] {
+        tracing on;
+        hvn::trace(hvn::trace_event::page_commit, hvn::trace_phase::instant, 4);
+        {
+            hvn::trace_scope scope(hvn::trace_event::job_run);
+        }
+
+        auto records = hvn::trace_snapshot();
+        expect(that % records.size() == 3U);
+        expect(records[0].event == hvn::trace_event::page_commit);
+        expect(that % records[0].arg == 4U);
+        expect(records[1].event == hvn::trace_event::job_run && records[1].phase == hvn::trace_phase::begin);
+        expect(records[2].event == hvn::trace_event::job_run && records[2].phase == hvn::trace_phase::end);
+        expect(that % records[0].timestamp <= records[2].timestamp);
+    };
+
+    "every thread records into its own buffer"_test = [] {
+        tracing on;
+        {
+            std::vector<std::jthread> threads;
+            for (int i = 0; i < 4; ++i) {
+                threads.emplace_back([] {
+                    for (int j = 0; j < 1000; ++j) {
+                        hvn::trace(hvn::trace_event::job_enqueue);
+                    }
+                });
+            }
+        }
+
+        auto records = hvn::trace_snapshot();
+        expect(that % count_of(records, hvn::trace_event::job_enqueue) == 4000);
+        std::vector<std::uint32_t> threads;
+        for (auto& record : records) threads.push_back(record.thread);
+        std::ranges::sort(threads);
+        expect(that % std::ranges::distance(threads.begin(), std::unique(threads.begin(), threads.end())) == 4);
+    };
+
+    "full buffers keep the latest events"_test = [] {
+        tracing on;
+        for (std::uint32_t i = 0; i < 100'000; ++i) {
+            hvn::trace(hvn::trace_event::io_submit, hvn::trace_phase::instant, i);
+        }
+
+        auto records = hvn::trace_snapshot();
+        expect(!records.empty());
+        expect(that % records.size() < 100'000U);
+        expect(that % records.back().arg == 99'999U);
+    };
+
+    "dumps load back"_test = [] {
+        tracing on;
+        hvn::trace(hvn::trace_event::page_loan, hvn::trace_phase::instant, 2);
+        hvn::trace(hvn::trace_event::io_complete, hvn::trace_phase::instant, 7);
+        auto records = hvn::trace_snapshot();
+
+        std::stringstream buf;
+        hvn::trace_dump(buf, records);
+        auto loaded = hvn::trace_load(buf);
+        expect(that % loaded.size() == records.size());
+        expect(std::ranges::equal(records, loaded, [](const auto& a, const auto& b) {
+            return a.timestamp == b.timestamp && a.thread == b.thread && a.arg == b.arg
+                   && a.event == b.event && a.phase == b.phase;
+        }));
+
+        std::stringstream garbage("definitely not a trace");
+        expect(throws<std::runtime_error>([&garbage] { std::ignore = hvn::trace_load(garbage); }));
+    };
+
+    "chrome json names every event"_test = [] {
+        tracing on;
+        {
+            hvn::trace_scope scope(hvn::trace_event::pool_add_puddle, 1);
+            hvn::trace(hvn::trace_event::puddle_retake_buffer);
+        }
+
+        std::ostringstream os;
+        hvn::trace_write_chrome_json(os, hvn::trace_snapshot());
+        auto json = os.str();
+        expect(json.starts_with(R"({"displayTimeUnit":"ns","traceEvents":[)"));
+        expect(json.find(R"("name":"pool add puddle","ph":"B")") != std::string::npos);
+        expect(json.find(R"("name":"pool add puddle","ph":"E")") != std::string::npos);
+        expect(json.find(R"("name":"puddle retake buffer","ph":"i")") != std::string::npos);
+    };
+};
+#endif
@@ -0,0 +1,197 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-12-01.
+ *
+ * test/exec/contract_engine --
+ *   Test suite for running the chains of contracts.
+ */
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/exec/contract-engine.hxx>
+#include <haven/mem/pool.hxx>
+
+using namespace boost::ut;
+
+namespace {
+    using buffer_pool = hvn::pool<std::array<int, 16>>;
+}
+
+[[maybe_unused]] const suite contract_engine_suite = [] {
+    "steps run in order on the starting thread"_test = [] {
+        hvn::executor exec(1);
+        hvn::contract_engine engine(exec);
+        buffer_pool buffers;
+        std::vector<int> order;
+        auto caller = std::this_thread::get_id();
+
+        auto chain = engine.chain(
+               [&](hvn::pool_handle buf) {
+                   order.push_back(1);
+                   buffers.resolve(buf)->front() = 10;
+                   return hvn::step_result::next(buf);
+               },
+               [&](hvn::pool_handle buf) {
+                   order.push_back(2);
+                   buffers.resolve(buf)->front() *= 2;
+                   expect(std::this_thread::get_id() == caller);
+                   return hvn::step_result::next(buf);
+               },
+               [&](hvn::pool_handle buf) {
+                   order.push_back(3);
+                   expect(that % buffers.resolve(buf)->front() == 20);
+                   buffers.deallocate(buf);
+                   return hvn::step_result::next({});
+               });
+        engine.start(chain, buffers.allocate_handle());
+        expect(order == std::vector<int>{1, 2, 3});
+    };
+
+    "the completing thread runs the rest of the chain"_test = [] {
+        hvn::executor exec(1);
+        hvn::contract_engine engine(exec);
+        std::atomic<hvn::contract> waiting{};
+        // the reporter is not thread-safe, results are checked by the main thread
+        std::thread::id ran_on;
+        hvn::pool_handle resumed_with;
+        std::atomic<bool> done = false;
+
+        auto chain = engine.chain(
+               [&](hvn::contract self, hvn::pool_handle) {
+                   waiting = self;
+                   return hvn::step_result::pending();
+               },
+               [&](hvn::pool_handle buf) {
+                   resumed_with = buf;
+                   ran_on = std::this_thread::get_id();
+                   done = true;
+                   return hvn::step_result::next(buf);
+               });
+        engine.start(chain, {});
+        expect(!done.load());
+
+        std::thread completer([&] { engine.resume(waiting.load(), hvn::pool_handle{7}); });
+        auto completer_id = completer.get_id();
+        completer.join();
+        expect(done.load());
+        expect(that % resumed_with.value() == 7U);
+        expect(ran_on == completer_id);
+    };
+
+    "resuming before the step returns goes on on the step's thread"_test = [] {
+        hvn::executor exec(1);
+        hvn::contract_engine engine(exec);
+        int steps = 0;
+
+        auto chain = engine.chain(
+               [&](hvn::contract self, hvn::pool_handle buf) {
+                   ++steps;
+                   engine.resume(self, buf);
+                   // the next step only runs once this one has returned
+                   expect(that % steps == 1);
+                   return hvn::step_result::pending();
+               },
+               [&](hvn::pool_handle buf) {
+                   ++steps;
+                   return hvn::step_result::next(buf);
+               });
+        engine.start(chain, {});
+        expect(that % steps == 2);
+    };
+
+    "stopping drops the rest of the chain"_test = [] {
+        hvn::executor exec(1);
+        hvn::contract_engine engine(exec);
+        auto token = std::make_shared<int>(0);
+        bool ran = false;
+
+        auto chain = engine.chain(
+               [](hvn::pool_handle) { return hvn::step_result::stop(); },
+               [token, &ran](hvn::pool_handle buf) {
+                   ran = true;
+                   return hvn::step_result::next(buf);
+               });
+        expect(that % token.use_count() == 2);
+        engine.start(chain, {});
+        expect(!ran);
+        expect(that % token.use_count() == 1);
+    };
+
+    "long chains continue on the executor"_test = [] {
+        hvn::executor exec(2);
+        hvn::contract_engine engine(exec, 2);
+        std::atomic<int> steps = 0;
+        std::array<std::thread::id, 5> ran_on{};
+        std::array<bool, 5> on_worker{};
+        auto step = [&](hvn::pool_handle buf) {
+            // steps run one after the other, the executor orders them
+            auto idx = steps.load();
+            ran_on[idx] = std::this_thread::get_id();
+            on_worker[idx] = exec.is_worker();
+            steps.fetch_add(1);
+            return hvn::step_result::next(buf);
+        };
+
+        auto chain = engine.chain(step, step, step, step, step);
+        engine.start(chain, {});
+        // not helping with wait_idle, which would run the rest right here
+        while (steps.load() < 5) std::this_thread::yield();
+        exec.wait_idle();
+
+        // the budget is spent on the starting thread, the rest is run by workers
+        auto caller = std::this_thread::get_id();
+        expect(ran_on[0] == caller && ran_on[1] == caller);
+        expect(!on_worker[0] && !on_worker[1]);
+        for (std::size_t i = 2; i < ran_on.size(); ++i) {
+            expect(ran_on[i] != caller) << "step" << i;
+            expect(on_worker[i]) << "step" << i;
+        }
+    };
+
+    "large steps are run"_test = [] {
+        hvn::executor exec(1);
+        hvn::contract_engine engine(exec);
+        std::array<int, 64> values{};
+        values.back() = 42;
+        int seen = 0;
+
+        auto chain = engine.chain([values, &seen](hvn::pool_handle buf) {
+            seen = values.back();
+            return hvn::step_result::next(buf);
+        });
+        engine.start(chain, {});
+        expect(that % seen == 42);
+    };
+    "destroying the engine releases the outstanding chains"_test = [] {
+        hvn::executor exec(1);
+        auto token = std::make_shared<int>(0);
+        bool ran = false;
+        {
+            hvn::contract_engine engine(exec);
+            auto step = [token, &ran](hvn::pool_handle buf) {
+                ran = true;
+                return hvn::step_result::next(buf);
+            };
+            std::ignore = engine.chain(step, step, step);
+
+            auto pending = engine.chain(
+                   [token](hvn::pool_handle) { return hvn::step_result::pending(); },
+                   step);
+            engine.start(pending, {});
+            expect(!ran);
+            // the token, the step, and the five nodes holding it
+            expect(that % token.use_count() == 7);
+        }
+        expect(!ran);
+        expect(that % token.use_count() == 1);
+    };
+};
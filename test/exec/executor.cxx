@@ -0,0 +1,170 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-26.
+ *
+ * test/exec/executor --
+ *   Test suite for the work-stealing executor.
+ */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/common/trace.hxx>
+#include <haven/exec/executor.hxx>
+
+using namespace boost::ut;
+
+[[maybe_unused]] const suite executor_suite = [] {
+    "executor runs posted work"_test = [] {
+        std::atomic<int> count = 0;
+        {
+            hvn::executor exec(2);
+            for (int i = 0; i < 1000; ++i) {
+                exec.post([&count] { count.fetch_add(1); });
+            }
+        }
+        expect(that % count.load() == 1000);
+    };
+
+    "work posted by workers is run"_test = [] {
+        std::atomic<int> count = 0;
+        hvn::executor exec(3);
+        for (int i = 0; i < 10; ++i) {
+            exec.post([&exec, &count] {
+                for (int j = 0; j < 100; ++j) {
+                    exec.post([&count] { count.fetch_add(1); });
+                }
+            });
+        }
+        exec.wait_idle();
+        expect(that % count.load() == 1000);
+        expect(!exec.is_worker());
+    };
+
+    "large callables are run"_test = [] {
+        std::atomic<int> sum = 0;
+        hvn::executor exec(1);
+        std::array<int, 64> values{};
+        values.back() = 42;
+        exec.post([values, &sum] { sum.fetch_add(values.back()); });
+        exec.wait_idle();
+        expect(that % sum.load() == 42);
+    };
+
+    "the queued count stays within what was posted"_test = [] {
+        constexpr const auto posters = 4;
+        constexpr const auto per_poster = 5000;
+        constexpr const auto total = std::size_t{posters * per_poster};
+
+        hvn::executor exec(3);
+        std::atomic<std::size_t> max_queued = 0;
+        auto sample = [&exec, &max_queued] {
+            auto queued = exec.queued();
+            auto seen = max_queued.load(std::memory_order_relaxed);
+            while (queued > seen && !max_queued.compare_exchange_weak(seen, queued)) { }
+        };
+
+        std::atomic<bool> posting = true;
+        std::jthread monitor([&posting, &sample] {
+            while (posting.load()) sample();
+        });
+        {
+            std::vector<std::jthread> threads;
+            for (int i = 0; i < posters; ++i) {
+                threads.emplace_back([&exec, &sample] {
+                    for (int j = 0; j < per_poster; ++j) {
+                        // workers posting as well go through their own deques
+                        exec.post([&exec, &sample] {
+                            sample();
+                            exec.post(sample);
+                        });
+                    }
+                });
+            }
+        }
+        exec.wait_idle();
+        posting = false;
+        monitor.join();
+
+        expect(that % max_queued.load() <= 2 * total);
+        expect(that % exec.queued() == 0U);
+    };
+
+    "callables failing to be stored are not run"_test = [] {
+        struct throwing_copy {
+            throwing_copy() = default;
+            throwing_copy(const throwing_copy&) { throw std::runtime_error("copy"); }
+
+            void
+            operator()() const noexcept { }
+        };
+        struct large_throwing_copy : throwing_copy {
+            std::array<int, 64> values{};
+        };
+
+        std::atomic<int> count = 0;
+        hvn::executor exec(1);
+        const throwing_copy small;
+        const large_throwing_copy large;
+        expect(throws<std::runtime_error>([&exec, &small] { exec.post(small); }));
+        expect(throws<std::runtime_error>([&exec, &large] { exec.post(large); }));
+        exec.post([&count] { count.fetch_add(1); });
+        exec.wait_idle();
+        expect(that % count.load() == 1);
+    };
+
+    "other threads can help"_test = [] {
+        std::atomic<int> count = 0;
+        hvn::executor exec(1);
+        std::atomic<bool> started = false;
+        std::atomic<bool> release = false;
+        exec.post([&started, &release] {
+            started = true;
+            while (!release.load()) std::this_thread::yield();
+        });
+        while (!started.load()) std::this_thread::yield();
+        for (int i = 0; i < 100; ++i) {
+            exec.post([&count] { count.fetch_add(1); });
+        }
+        // the only worker is blocked, the work is done by the helping thread
+        while (count.load() < 100) {
+            std::ignore = exec.try_run_one();
+        }
+        release = true;
+        exec.wait_idle();
+        expect(that % count.load() == 100);
+    };
+#ifdef HAVEN_TRACE_EVENTS
+    "traced jobs are matched to their runs"_test = [] {
+        hvn::trace_clear();
+        hvn::trace_enable(true);
+        {
+            hvn::executor exec(2);
+            for (int i = 0; i < 100; ++i) {
+                exec.post([] { });
+            }
+        }
+        hvn::trace_enable(false);
+
+        auto records = hvn::trace_snapshot();
+        std::multiset<std::uint32_t> enqueued;
+        std::multiset<std::uint32_t> run;
+        for (const auto& record : records) {
+            if (record.event == hvn::trace_event::job_enqueue) enqueued.insert(record.arg);
+            if (record.event == hvn::trace_event::job_run && record.phase == hvn::trace_phase::begin) run.insert(record.arg);
+        }
+        expect(that % enqueued.size() == 100U);
+        expect(enqueued == run);
+        hvn::trace_clear();
+    };
+#endif
+};
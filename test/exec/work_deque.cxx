@@ -0,0 +1,89 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-26.
+ *
+ * test/exec/work_deque --
+ *   Test suite for the work-stealing deque.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/exec/work-deque.hxx>
+
+using namespace boost::ut;
+
+[[maybe_unused]] const suite work_deque_suite = [] {
+    "owner pops in lifo order"_test = [] {
+        hvn::work_deque<int> deque;
+        int items[3]{};
+        for (auto& item : items) deque.push(&item);
+        expect(that % deque.pop() == &items[2]);
+        expect(that % deque.pop() == &items[1]);
+        expect(that % deque.pop() == &items[0]);
+        expect(that % deque.pop() == nullptr);
+        expect(deque.empty());
+    };
+
+    "thieves steal in fifo order"_test = [] {
+        hvn::work_deque<int> deque;
+        int items[3]{};
+        for (auto& item : items) deque.push(&item);
+        expect(that % deque.steal() == &items[0]);
+        expect(that % deque.steal() == &items[1]);
+        expect(that % deque.pop() == &items[2]);
+        expect(that % deque.steal() == nullptr);
+    };
+
+    "deque grows past its capacity"_test = [] {
+        hvn::work_deque<int> deque(4);
+        std::vector<int> items(100);
+        for (auto& item : items) deque.push(&item);
+        expect(that % deque.steal() == &items[0]);
+        auto good = true;
+        for (auto i = items.size() - 1; i > 0; --i) {
+            good = good && deque.pop() == &items[i];
+        }
+        expect(good);
+        expect(deque.empty());
+    };
+
+    "every item is taken exactly once"_test = [] {
+        constexpr const auto item_count = 20'000;
+        hvn::work_deque<int> deque(16);
+        std::vector<int> items(item_count);
+        std::vector<std::atomic<int>> taken(item_count);
+        std::atomic<bool> done = false;
+
+        auto take = [&](int* item) {
+            taken[static_cast<std::size_t>(item - items.data())].fetch_add(1);
+        };
+        std::vector<std::jthread> thieves;
+        for (int i = 0; i < 3; ++i) {
+            thieves.emplace_back([&] {
+                while (!done.load() || !deque.empty()) {
+                    if (auto item = deque.steal()) take(item);
+                    else std::this_thread::yield();
+                }
+            });
+        }
+
+        for (auto& item : items) {
+            deque.push(&item);
+            if ((&item - items.data()) % 3 == 0) {
+                if (auto popped = deque.pop()) take(popped);
+            }
+        }
+        while (auto item = deque.pop()) take(item);
+        done = true;
+        thieves.clear();
+
+        expect(std::ranges::all_of(taken, [](auto& count) { return count.load() == 1; }));
+    };
+};
@@ -0,0 +1,44 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-29.
+ *
+ * test/io/byte_scan --
+ *   Test suite for the byte scanners.
+ */
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/io/byte-scan.hxx>
+
+using namespace boost::ut;
+
+[[maybe_unused]] const suite byte_scan_suite = [] {
+    "scanners agree on every position and size"_test = [] {
+        for (std::size_t size = 0; size < 300; size += 7) {
+            std::vector<std::byte> data(size, std::byte{'x'});
+            expect(that % hvn::simd_scanner::find(data, std::byte{'\n'}) == size);
+            expect(that % hvn::memchr_scanner::find(data, std::byte{'\n'}) == size);
+
+            for (std::size_t at = 0; at < size; at += 5) {
+                data[at] = std::byte{'\n'};
+                expect(that % hvn::simd_scanner::find(data, std::byte{'\n'}) == at);
+                expect(that % hvn::memchr_scanner::find(data, std::byte{'\n'}) == at);
+                data[at] = std::byte{'x'};
+            }
+        }
+    };
+
+    "scanners find the first of many"_test = [] {
+        std::vector<std::byte> data(256, std::byte{0});
+        data[200] = std::byte{0xFF};
+        data[70] = std::byte{0xFF};
+        expect(that % hvn::simd_scanner::find(data, std::byte{0xFF}) == 70U);
+        expect(that % hvn::simd_scanner::find(std::span(data).subspan(71), std::byte{0xFF}) == 129U);
+    };
+};
@@ -0,0 +1,165 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-30.
+ *
+ * test/io/file_dock --
+ *   Test suite for the file docks, in both buffered and direct modes.
+ *   Direct mode falls back to buffered where the temporary directory does
+ *   not support it, the results must be the same either way. Whether direct
+ *   mode is kept is checked against a probe of the temporary directory.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <span>
+#include <string>
+#include <system_error>
+
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <boost/ut.hpp>
+#include <haven/io/file-dock.hxx>
+#include <haven/mem/page-allocator.hxx>
+
+using namespace boost::ut;
+
+namespace {
+    struct temp_file {
+        // suffixed, so concurrently running suites do not share files
+        std::filesystem::path path = std::filesystem::temp_directory_path()
+                                     / ("hvn-io-tests-dock-" + std::to_string(std::random_device{}()) + ".bin");
+
+        temp_file() { std::filesystem::remove(path); }
+        ~temp_file() { std::filesystem::remove(path); }
+    };
+
+    constexpr const hvn::file_caching cachings[] = {hvn::file_caching::buffered, hvn::file_caching::direct};
+
+    // whether an aligned direct write works in the temporary directory
+    bool
+    direct_supported() {
+#if defined(_WIN32) || (!defined(O_DIRECT) && defined(F_NOCACHE))
+        return true;
+#elif defined(O_DIRECT)
+        temp_file file;
+        auto fd = open(file.path.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0600);
+        if (fd < 0) return false;
+        hvn::page_allocator alloc;
+        auto page = alloc.allocate(alloc.page_size());
+        auto ok = pwrite(fd, page.base_addr(), page.size(), 0) == static_cast<ssize_t>(page.size());
+        alloc.deallocate(page);
+        close(fd);
+        return ok;
+#else
+        return false;
+#endif
+    }
+
+    // whether a dock opened with the caching is to stay direct
+    bool
+    expect_direct(hvn::file_caching caching) {
+        static const auto supported = direct_supported();
+        return caching == hvn::file_caching::direct && supported;
+    }
+
+    std::byte
+    pattern(std::size_t idx) noexcept {
+        return static_cast<std::byte>(idx * 31 + idx / 7);
+    }
+}
+
+[[maybe_unused]] const suite file_dock_suite = [] {
+    "aligned blocks round trip"_test = [] {
+        for (auto caching : cachings) {
+            temp_file file;
+            hvn::page_allocator alloc;
+            auto page_size = alloc.page_size();
+            auto page = alloc.allocate(4 * page_size);
+            auto block = std::span(page.base_addr(), page.size());
+            for (std::size_t i = 0; i < block.size(); ++i) block[i] = pattern(i);
+
+            {
+                hvn::file_dock dock(file.path, hvn::file_access::write, caching);
+                dock.write(block.first(2 * page_size), 0);
+                dock.write(block.subspan(2 * page_size), 2 * page_size);
+                dock.sync();
+                expect(that % dock.size() == block.size());
+                expect(dock.is_direct() == expect_direct(caching));
+            }
+
+            std::ranges::fill(block, std::byte{0});
+            hvn::file_dock dock(file.path, hvn::file_access::read, caching);
+            expect(that % dock.read(block, 0) == block.size());
+            expect(dock.is_direct() == expect_direct(caching));
+            for (std::size_t i = 0; i < block.size(); ++i) {
+                if (block[i] != pattern(i)) {
+                    expect(false) << "mismatch at" << i;
+                    break;
+                }
+            }
+            alloc.deallocate(page);
+        }
+    };
+
+    "unaligned tails go buffered"_test = [] {
+        for (auto caching : cachings) {
+            temp_file file;
+            hvn::page_allocator alloc;
+            auto page_size = alloc.page_size();
+            auto page = alloc.allocate(2 * page_size);
+            auto block = std::span(page.base_addr(), page.size());
+            for (std::size_t i = 0; i < block.size(); ++i) block[i] = pattern(i);
+
+            hvn::file_dock dock(file.path, hvn::file_access::read_write, caching);
+            // one and a bit block at an aligned offset, then an unaligned one
+            dock.write(block.first(page_size + 100), 0);
+            dock.write(block.subspan(page_size + 100, 50), page_size + 100);
+            expect(that % dock.size() == page_size + 150);
+
+            std::ranges::fill(block, std::byte{0});
+            expect(that % dock.read(block, 0) == page_size + 150);
+            expect(block[page_size + 149] == pattern(page_size + 149));
+            expect(block[page_size + 150] == std::byte{0});
+
+            // unaligned offset and memory
+            expect(that % dock.read(block.subspan(1, 10), 7) == 10U);
+            expect(block[1] == pattern(7));
+            expect(dock.is_direct() == expect_direct(caching));
+            alloc.deallocate(page);
+        }
+    };
+
+    "reads stop at the end of the file"_test = [] {
+        for (auto caching : cachings) {
+            temp_file file;
+            hvn::page_allocator alloc;
+            auto page_size = alloc.page_size();
+            auto page = alloc.allocate(page_size);
+            auto block = std::span(page.base_addr(), page.size());
+
+            hvn::file_dock dock(file.path, hvn::file_access::read_write, caching);
+            expect(that % dock.read(block, 0) == 0U);
+            dock.write(block.first(10), 0);
+            expect(that % dock.read(block, 0) == 10U);
+            expect(that % dock.read(block, page_size) == 0U);
+            expect(dock.is_direct() == expect_direct(caching));
+            alloc.deallocate(page);
+        }
+    };
+
+    "opening a missing file for reading throws"_test = [] {
+        temp_file file;
+        expect(throws<std::system_error>([&file] {
+            hvn::file_dock dock(file.path, hvn::file_access::read, hvn::file_caching::direct);
+        }));
+    };
+};
@@ -0,0 +1,16 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-29.
+ *
+ * test/io/main --
+ *   Main entry point to the suite.
+ *   Tests are run automagically.
+ */
+
+int
+main() {
+    /*test suites autorun*/
+}
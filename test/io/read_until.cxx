@@ -0,0 +1,198 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-29.
+ *
+ * test/io/read_until --
+ *   Test suite for the delimiter framer of the read_until contract, and
+ *   reading frames from a file dock.
+ */
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/io/read-until.hxx>
+
+using namespace boost::ut;
+
+namespace {
+    using block = std::shared_ptr<const std::string>;
+
+    std::string
+    to_string(const hvn::read_frame<block>& frame) {
+        std::string ret(frame.size(), '\0');
+        frame.copy_to(reinterpret_cast<std::byte*>(ret.data()));
+        return ret;
+    }
+
+    // the frames expected from splitting the whole input at once
+    std::vector<std::string>
+    split(std::string_view input, std::string_view delimiter) {
+        std::vector<std::string> ret;
+        std::size_t start = 0;
+        for (auto at = input.find(delimiter); at != std::string_view::npos; at = input.find(delimiter, start)) {
+            ret.emplace_back(input.substr(start, at - start));
+            start = at + delimiter.size();
+        }
+        if (start < input.size()) ret.emplace_back(input.substr(start));
+        return ret;
+    }
+
+    // feeds the input to the framer cut into blocks of block_size bytes
+    template<class Scanner = hvn::simd_scanner>
+    std::vector<std::string>
+    frame(std::string_view input, std::string_view delimiter, std::size_t block_size) {
+        hvn::delimiter_framer<block, Scanner> framer(delimiter);
+        std::vector<std::string> ret;
+        auto collect = [&ret](const auto& frame) { ret.push_back(to_string(frame)); };
+        for (std::size_t i = 0; i < input.size(); i += block_size) {
+            auto blk = std::make_shared<const std::string>(input.substr(i, block_size));
+            auto data = std::as_bytes(std::span(*blk));
+            framer.push(std::move(blk), data, collect);
+        }
+        framer.finish(collect);
+        return ret;
+    }
+}
+
+[[maybe_unused]] const suite read_until_suite = [] {
+    "frames in a single block are one piece"_test = [] {
+        hvn::delimiter_framer<block> framer("\r\n");
+        auto blk = std::make_shared<const std::string>("GET / HTTP/1.1\r\nHost: x\r\n\r\n");
+        auto data = std::as_bytes(std::span(*blk));
+
+        std::vector<std::string> frames;
+        auto count = framer.push(blk, data, [&frames, &blk](const auto& frame) {
+            expect(frame.contiguous());
+            expect(that % frame.blocks.size() == 1U);
+            // zero-copy: the frame views the block itself
+            if (!frame.empty()) expect(reinterpret_cast<const char*>(frame.bytes().data()) >= blk->data());
+            frames.push_back(to_string(frame));
+        });
+        expect(that % count == 3U);
+        expect(frames == std::vector<std::string>{"GET / HTTP/1.1", "Host: x", ""});
+        expect(that % framer.retained() == 0U);
+        expect(!framer.finish([](const auto&) {}));
+    };
+
+    "frames spanning blocks keep them until complete"_test = [] {
+        hvn::delimiter_framer<block> framer(std::string_view("\0", 1));
+        auto first = std::make_shared<const std::string>("abc");
+        auto second = std::make_shared<const std::string>(std::string("de\0f", 4));
+
+        std::size_t pieces = 0;
+        framer.push(first, std::as_bytes(std::span(*first)), [](const auto&) { expect(false); });
+        expect(that % framer.retained() == 1U);
+        expect(that % framer.pending() == 3U);
+
+        framer.push(second, std::as_bytes(std::span(*second)), [&pieces](const auto& frame) {
+            pieces = frame.pieces.size();
+            expect(that % to_string(frame) == std::string("abcde"));
+            expect(that % frame.blocks.size() == 2U);
+        });
+        expect(that % pieces == 2U);
+        expect(that % framer.retained() == 1U);
+        expect(that % framer.pending() == 1U);
+    };
+
+    "delimiters straddling blocks are found"_test = [] {
+        expect(frame("ab\r\ncd", "\r\n", 3) == std::vector<std::string>{"ab", "cd"});
+        expect(frame("ab|||cd|||", "|||", 3) == std::vector<std::string>{"ab", "cd"});
+        expect(frame("a\r\r\nb", "\r\n", 2) == std::vector<std::string>{"a\r", "b"});
+    };
+
+    "partial delimiters at the end are data"_test = [] {
+        expect(frame("ab\r", "\r\n", 2) == std::vector<std::string>{"ab\r"});
+    };
+
+    "framing does not depend on where blocks are cut"_test = [] {
+        std::string input;
+        for (int i = 0; i < 200; ++i) {
+            input += std::string(static_cast<std::size_t>(i % 23), static_cast<char>('a' + i % 3));
+            input += i % 5 == 0 ? "abab" : "ab";
+        }
+
+        for (std::string_view delimiter : {"\n", "b", "ab", "abab", "aab", "\r\n"}) {
+            auto expected = split(input, delimiter);
+            for (std::size_t block_size = 1; block_size < 70; ++block_size) {
+                expect(frame(input, delimiter, block_size) == expected) << delimiter << block_size;
+                expect(frame<hvn::memchr_scanner>(input, delimiter, block_size) == expected) << delimiter << block_size;
+            }
+        }
+    };
+
+    "move-only blocks are retained"_test = [] {
+        using unique_block = std::unique_ptr<std::string>;
+        hvn::delimiter_framer<unique_block> framer("\n");
+
+        std::vector<std::string> frames;
+        auto collect = [&frames](const hvn::read_frame<unique_block>& frame) {
+            std::string str(frame.size(), '\0');
+            frame.copy_to(reinterpret_cast<std::byte*>(str.data()));
+            frames.push_back(str);
+        };
+        for (auto part : {"one\ntw", "o\nthr", "ee"}) {
+            auto blk = std::make_unique<std::string>(part);
+            auto data = std::as_bytes(std::span(*blk));
+            framer.push(std::move(blk), data, collect);
+        }
+        expect(framer.finish(collect));
+        expect(frames == std::vector<std::string>{"one", "two", "three"});
+    };
+    "blocks are reused once released"_test = [] {
+        hvn::dock_block_cache cache(hvn::page_allocator::page_size());
+        {
+            auto first = cache.acquire();
+            auto second = cache.acquire();
+            expect(that % first.bytes().size() == cache.block_size());
+            expect(first.bytes().data() != second.bytes().data());
+        }
+        auto again = cache.acquire();
+        expect(that % cache.allocated() == 2U);
+    };
+
+    "read_until frames a file read through a dock"_test = [] {
+        auto path = std::filesystem::temp_directory_path()
+                    / ("hvn-io-tests-read-until-" + std::to_string(std::random_device{}()) + ".txt");
+        // lines from empty to longer than a block, and a tail without newline
+        auto page_size = hvn::page_allocator::page_size();
+        std::string input;
+        for (std::size_t i = 0; i < 60; ++i) {
+            input += std::string(i * i * 3 % (2 * page_size + 7), static_cast<char>('a' + i % 26));
+            input += '\n';
+        }
+        input += "tail";
+        {
+            std::ofstream out(path, std::ios::binary);
+            out.write(input.data(), static_cast<std::streamsize>(input.size()));
+        }
+
+        auto expected = split(input, "\n");
+        for (auto caching : {hvn::file_caching::buffered, hvn::file_caching::direct}) {
+            hvn::file_dock dock(path, hvn::file_access::read, caching);
+            std::vector<std::string> frames;
+            auto count = hvn::read_until(
+                   dock,
+                   "\n",
+                   [&frames](const hvn::read_frame<hvn::dock_block>& frame) {
+                       std::string str(frame.size(), '\0');
+                       frame.copy_to(reinterpret_cast<std::byte*>(str.data()));
+                       frames.push_back(str);
+                   },
+                   1);
+            expect(that % count == expected.size());
+            expect(frames == expected);
+        }
+        std::filesystem::remove(path);
+    };
+};
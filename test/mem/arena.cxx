@@ -0,0 +1,137 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-25.
+ *
+ * test/mem/arena --
+ *   Test suite for the arena and the arena cache.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/mem/arena.hxx>
+
+using namespace boost::ut;
+
+namespace {
+    constexpr const auto arena_size = std::size_t{1} << 20;
+}
+
+[[maybe_unused]] const suite arena_suite = [] {
+    "arena allocates aligned memory"_test = [] {
+        hvn::page_allocator alloc;
+        hvn::arena arena(&alloc, arena_size);
+
+        auto c = static_cast<char*>(arena.allocate_bytes(1, 1));
+        *c = 'a';
+        auto d = static_cast<double*>(arena.allocate_bytes(sizeof(double), alignof(double)));
+        *d = 4.2;
+        expect(that % (reinterpret_cast<std::uintptr_t>(d) % alignof(double)) == 0U);
+        auto big = arena.allocate_bytes(64, 64);
+        expect(that % (reinterpret_cast<std::uintptr_t>(big) % 64) == 0U);
+        expect(that % *c == 'a');
+        expect(that % arena.used() >= std::size_t{1 + sizeof(double) + 64});
+    };
+
+    "arena commits only what is used"_test = [] {
+        hvn::page_allocator alloc;
+        hvn::arena arena(&alloc, arena_size, 1);
+        expect(that % arena.committed() == 0U);
+
+        auto mem = static_cast<std::byte*>(arena.allocate_bytes(alloc.page_size() + 1, 1));
+        mem[alloc.page_size()] = std::byte{1};
+        expect(that % arena.committed() == 2 * alloc.page_size());
+    };
+
+    "arena throws when the reservation runs out"_test = [] {
+        hvn::page_allocator alloc;
+        hvn::arena arena(&alloc, arena_size);
+        expect(throws<std::bad_alloc>([&arena] { std::ignore = arena.allocate_bytes(arena_size + 1, 1); }));
+        std::ignore = arena.allocate_bytes(arena_size, 1);
+        expect(throws<std::bad_alloc>([&arena] { std::ignore = arena.allocate_bytes(1, 1); }));
+    };
+
+    "reset rewinds the bump pointer"_test = [] {
+        hvn::page_allocator alloc;
+        hvn::arena arena(&alloc, arena_size);
+        auto first = arena.allocate_bytes(100, 8);
+        std::ignore = arena.allocate_bytes(100, 8);
+        arena.reset();
+        expect(that % arena.used() == 0U);
+        expect(that % arena.allocate_bytes(100, 8) == first);
+    };
+
+    "reset trims above the high-water mark"_test = [] {
+        hvn::page_allocator alloc;
+        hvn::arena arena(&alloc, arena_size, 1);
+        auto page = alloc.page_size();
+
+        std::ignore = arena.allocate_bytes(8 * page, 1);
+        arena.reset(hvn::arena_trim::decommit, 2 * page);
+        expect(that % arena.committed() == 2 * page);
+
+        auto mem = static_cast<std::byte*>(arena.allocate_bytes(8 * page, 1));
+        mem[7 * page] = std::byte{42};
+        expect(that % arena.committed() == 8 * page);
+
+        arena.reset(hvn::arena_trim::loan, page);
+        expect(that % arena.committed() <= 8 * page);
+        mem = static_cast<std::byte*>(arena.allocate_bytes(8 * page, 1));
+        mem[7 * page] = std::byte{42};
+        expect(that % arena.committed() == 8 * page);
+    };
+
+    "arena is a memory resource"_test = [] {
+        hvn::page_allocator alloc;
+        hvn::arena arena(&alloc, arena_size);
+        std::pmr::vector<std::pmr::string> strings(&arena);
+        for (int i = 0; i < 1000; ++i) {
+            strings.emplace_back("a string long enough to not fit into the small buffer");
+        }
+        expect(that % strings.size() == 1000U);
+        expect(that % arena.used() > 1000U * 50);
+        expect(arena.is_equal(arena));
+
+        // the memory_resource interface is usable on the arena itself
+        auto mem = arena.allocate(64, 64);
+        expect(that % (reinterpret_cast<std::uintptr_t>(mem) % 64) == 0U);
+        arena.deallocate(mem, 64, 64);
+    };
+
+    "arena cache reuses arenas"_test = [] {
+        hvn::arena_cache<> cache(arena_size, hvn::arena_trim::decommit);
+        void* first;
+        {
+            auto lease = cache.acquire();
+            first = lease->allocate_bytes(16);
+        }
+        expect(that % cache.idle_count() == 1U);
+
+        auto lease = cache.acquire();
+        expect(that % cache.idle_count() == 0U);
+        expect(that % lease->used() == 0U);
+        expect(that % lease->allocate_bytes(16) == first);
+
+        auto other = cache.acquire();
+        expect(that % other.get() != lease.get());
+    };
+
+    "arena cache keeps a bounded number of arenas"_test = [] {
+        hvn::arena_cache<> cache(arena_size, hvn::arena_trim::keep, 0, 2);
+        {
+            std::vector<hvn::arena_cache<>::lease> leases;
+            for (int i = 0; i < 5; ++i) {
+                leases.push_back(cache.acquire());
+            }
+        }
+        expect(that % cache.idle_count() == 2U);
+    };
+};
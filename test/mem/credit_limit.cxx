@@ -0,0 +1,281 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-27.
+ *
+ * test/mem/credit_limit --
+ *   Test suite for the credit limits of write blocks.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#  include <fcntl.h>
+#  include <io.h>
+#else
+#  include <unistd.h>
+#endif
+
+#include <boost/ut.hpp>
+#include <haven/mem/credit-limit.hxx>
+
+using namespace boost::ut;
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr const auto block_size = std::size_t{4096};
+
+    struct local_pipe {
+        local_pipe() {
+#ifdef _WIN32
+            std::ignore = _pipe(fds, block_size, _O_BINARY);
+#else
+            std::ignore = pipe(fds);
+#endif
+        }
+
+        ~local_pipe() {
+            close_write();
+#ifdef _WIN32
+            _close(fds[0]);
+#else
+            close(fds[0]);
+#endif
+        }
+
+        void
+        write_block(const std::byte* data) {
+            std::size_t done = 0;
+            while (done < block_size) {
+#ifdef _WIN32
+                auto n = _write(fds[1], data + done, static_cast<unsigned>(block_size - done));
+#else
+                auto n = write(fds[1], data + done, block_size - done);
+#endif
+                if (n <= 0) return;
+                done += static_cast<std::size_t>(n);
+            }
+        }
+
+        bool
+        read_some(std::byte* data, std::size_t size) {
+#ifdef _WIN32
+            return _read(fds[0], data, static_cast<unsigned>(size)) > 0;
+#else
+            return read(fds[0], data, size) > 0;
+#endif
+        }
+
+        void
+        close_write() {
+            if (fds[1] < 0) return;
+#ifdef _WIN32
+            _close(std::exchange(fds[1], -1));
+#else
+            close(std::exchange(fds[1], -1));
+#endif
+        }
+
+        int fds[2]{-1, -1};
+    };
+
+    // writes the blocks handed to it into the pipe, returning the credits of
+    // each block once it has been written out, like a write completion would
+    struct pipe_writer {
+        explicit pipe_writer(local_pipe& pipe)
+             : _thread([this, &pipe] {
+                   std::array<std::byte, block_size> block{};
+                   for (;;) {
+                       std::unique_lock lck(_mx);
+                       _cv.wait(lck, [this] { return _done || !_queue.empty(); });
+                       if (_queue.empty()) return;
+                       auto grant = std::move(_queue.front());
+                       _queue.pop_front();
+                       lck.unlock();
+
+                       pipe.write_block(block.data());
+                       _live.fetch_sub(1, std::memory_order_relaxed);
+                       grant.reset();
+                   }
+               }) { }
+
+        ~pipe_writer() {
+            {
+                std::scoped_lock lck(_mx);
+                _done = true;
+            }
+            _cv.notify_one();
+        }
+
+        void
+        submit(hvn::credit_grant grant) {
+            {
+                std::scoped_lock lck(_mx);
+                _queue.push_back(std::move(grant));
+            }
+            // the blocks queued or being written, counted apart from the credits
+            auto live = _live.fetch_add(1, std::memory_order_relaxed) + 1;
+            _max_live = std::max(_max_live, live);
+            _cv.notify_one();
+        }
+
+        // the most blocks the writer has held at once
+        [[nodiscard]] std::size_t
+        max_live() const noexcept { return _max_live; }
+
+    private:
+        std::mutex _mx;
+        std::condition_variable _cv;
+        std::deque<hvn::credit_grant> _queue;
+        std::atomic<std::size_t> _live = 0;
+        std::size_t _max_live = 0; // only touched by the submitting thread
+        bool _done = false;
+        std::jthread _thread;
+    };
+
+    // reads the pipe a bit at a time, taking a nap in between
+    std::jthread
+    slow_reader(local_pipe& pipe) {
+        return std::jthread([&pipe] {
+            std::array<std::byte, 512> buf{};
+            while (pipe.read_some(buf.data(), buf.size())) {
+                std::this_thread::sleep_for(100us);
+            }
+        });
+    }
+}
+
+[[maybe_unused]] const suite credit_limit_suite = [] {
+    "try_acquire fails fast when out of credits"_test = [] {
+        hvn::credit_limit limit(2);
+        auto first = limit.try_acquire();
+        auto second = limit.try_acquire();
+        expect(static_cast<bool>(first) && static_cast<bool>(second));
+        expect(!limit.try_acquire());
+        expect(that % limit.outstanding() == 2U);
+
+        first.reset();
+        expect(that % limit.available() == 1U);
+        expect(static_cast<bool>(limit.try_acquire()));
+    };
+
+    "dock limits share the harbor limit"_test = [] {
+        hvn::credit_limit harbor(3);
+        hvn::credit_limit dock_a(2, &harbor);
+        hvn::credit_limit dock_b(2, &harbor);
+
+        auto a = dock_a.try_acquire(2);
+        auto b = dock_b.try_acquire();
+        expect(static_cast<bool>(a) && static_cast<bool>(b));
+        // dock_b has credits left, the harbor does not
+        expect(!dock_b.try_acquire());
+        expect(that % dock_b.available() == 1U);
+
+        a.reset();
+        expect(that % harbor.available() == 2U);
+        expect(static_cast<bool>(dock_b.try_acquire()));
+    };
+
+    "async acquire continues when credits are returned"_test = [] {
+        hvn::credit_limit harbor(2);
+        hvn::credit_limit dock(2, &harbor);
+        auto held = dock.try_acquire(2);
+
+        std::vector<int> order;
+        std::vector<hvn::credit_grant> grants;
+        dock.acquire_async(1, [&](hvn::credit_grant grant) {
+            order.push_back(1);
+            grants.push_back(std::move(grant));
+        });
+        dock.acquire_async(1, [&](hvn::credit_grant grant) {
+            order.push_back(2);
+            grants.push_back(std::move(grant));
+        });
+        expect(order.empty());
+        // waiters are not to be overtaken
+        expect(!dock.try_acquire());
+
+        held.reset();
+        expect(that % order.size() == 2U);
+        expect(order == std::vector{1, 2});
+        expect(that % harbor.outstanding() == 2U);
+    };
+
+    "blocking acquire waits for credits"_test = [] {
+        hvn::credit_limit limit(1);
+        auto held = limit.try_acquire();
+        std::atomic<bool> acquired = false;
+        std::jthread waiter([&] {
+            auto grant = limit.acquire();
+            acquired = true;
+        });
+        std::this_thread::sleep_for(10ms);
+        expect(!acquired.load());
+        held.reset();
+        waiter.join();
+        expect(acquired.load());
+        expect(that % limit.available() == 1U);
+    };
+
+    "outstanding blocks are bounded with a slow reader"_test = [] {
+        constexpr const auto limit_count = std::size_t{4};
+        constexpr const auto block_count = 256;
+
+        hvn::credit_limit harbor(limit_count * 2);
+        hvn::credit_limit dock(limit_count, &harbor);
+        local_pipe pipe;
+        auto reader = slow_reader(pipe);
+
+        std::size_t max_live = 0;
+        {
+            pipe_writer writer(pipe);
+            for (int i = 0; i < block_count; ++i) {
+                writer.submit(dock.acquire());
+            }
+            max_live = writer.max_live();
+        }
+        pipe.close_write();
+
+        // the reader is slow enough for the writer to fill up to the limit
+        expect(that % max_live == limit_count);
+        expect(that % harbor.outstanding() == 0U);
+    };
+
+    "fail fast producers are turned away with a slow reader"_test = [] {
+        constexpr const auto limit_count = std::size_t{4};
+        constexpr const auto block_count = 256;
+
+        hvn::credit_limit dock(limit_count);
+        local_pipe pipe;
+        auto reader = slow_reader(pipe);
+
+        int rejected = 0;
+        {
+            pipe_writer writer(pipe);
+            for (int sent = 0; sent < block_count;) {
+                if (auto grant = dock.try_acquire()) {
+                    writer.submit(std::move(grant));
+                    ++sent;
+                }
+                else {
+                    ++rejected;
+                    std::this_thread::yield();
+                }
+            }
+        }
+        pipe.close_write();
+
+        expect(that % rejected > 0);
+        expect(that % dock.outstanding() == 0U);
+    };
+};
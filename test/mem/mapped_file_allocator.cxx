@@ -0,0 +1,170 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-24.
+ *
+ * test/mem/mapped_file_allocator --
+ *   Test suite for the file-backed allocator.
+ *   Puddles using it are tested by the puddle suite.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/mem/mapped-file-allocator.hxx>
+#include <haven/mem/pool.hxx>
+
+using namespace boost::ut;
+
+namespace {
+    struct temp_file {
+        // suffixed, so concurrently running suites do not share files
+        std::filesystem::path path = std::filesystem::temp_directory_path()
+                                     / ("hvn-mem-tests-allocator-" + std::to_string(std::random_device{}()) + ".map");
+
+        temp_file() { std::filesystem::remove(path); }
+        ~temp_file() { std::filesystem::remove(path); }
+    };
+
+    constexpr const auto test_bytes = std::string_view("libhaven mapped page");
+}
+
+[[maybe_unused]] const suite mapped_file_allocator_suite = [] {
+    const auto page_size = hvn::mapped_file_allocator::page_size();
+
+    "committed pages are usable memory"_test = [page_size] {
+        temp_file file;
+        hvn::mapped_file_allocator alloc(file.path, 16 * page_size);
+        auto page = alloc.allocate(page_size);
+        std::ranges::fill_n(page.base_addr(), page.size(), std::byte{0x2A});
+        expect(std::ranges::all_of(page.base_addr(), page.base_addr() + page.size(), [](auto b) {
+            return b == std::byte{0x2A};
+        }));
+        alloc.deallocate(page);
+    };
+
+    "reserving grows the backing file"_test = [page_size] {
+        temp_file file;
+        hvn::mapped_file_allocator alloc(file.path, 16 * page_size);
+        auto first = alloc.reserve(2 * page_size);
+        auto second = alloc.reserve(page_size);
+        expect(that % alloc.file_offset(first) == 0u);
+        expect(that % alloc.file_offset(second) == 2 * page_size);
+        expect(that % std::filesystem::file_size(file.path) >= 3 * page_size);
+        alloc.deallocate(first);
+        alloc.deallocate(second);
+    };
+
+    "reserving beyond the capacity fails"_test = [page_size] {
+        temp_file file;
+        hvn::mapped_file_allocator alloc(file.path, 2 * page_size);
+        auto page = alloc.reserve(2 * page_size);
+        expect(throws<std::bad_alloc>([&alloc, page_size] {
+            std::ignore = alloc.reserve(page_size);
+        }));
+        alloc.deallocate(page);
+    };
+
+    "contents survive decommitting and loaning"_test = [page_size] {
+        temp_file file;
+        hvn::mapped_file_allocator alloc(file.path, 16 * page_size);
+        auto page = alloc.allocate(page_size);
+        std::memcpy(page.base_addr(), test_bytes.data(), test_bytes.size());
+
+        page = alloc.commit(alloc.decommit(page));
+        expect(std::memcmp(page.base_addr(), test_bytes.data(), test_bytes.size()) == 0);
+
+        auto loaned = alloc.loan(page);
+        page = std::visit([&alloc](auto p) { return alloc.commit(p); }, loaned);
+        expect(std::memcmp(page.base_addr(), test_bytes.data(), test_bytes.size()) == 0);
+        alloc.deallocate(page);
+    };
+
+    "contents survive reopening the file"_test = [page_size] {
+        temp_file file;
+        {
+            hvn::mapped_file_allocator alloc(file.path, 16 * page_size);
+            auto page = alloc.allocate(page_size);
+            std::memcpy(page.base_addr(), test_bytes.data(), test_bytes.size());
+            alloc.flush();
+            std::ignore = alloc.decommit(page);
+        }
+        hvn::mapped_file_allocator alloc(file.path, 16 * page_size);
+        auto page = alloc.allocate(page_size);
+        expect(std::memcmp(page.base_addr(), test_bytes.data(), test_bytes.size()) == 0);
+        alloc.deallocate(page);
+    };
+
+    "pool can use the mapped file allocator"_test = [page_size] {
+        temp_file file;
+        hvn::pool<std::uint64_t, hvn::mapped_file_allocator> pool(std::in_place, file.path, 64 * page_size);
+        std::vector<std::uint64_t*> buf;
+        for (std::uint64_t i = 0; i < 4096; ++i) {
+            buf.push_back(pool.allocate(i));
+        }
+        auto good = true;
+        for (std::uint64_t i = 0; i < buf.size(); ++i) {
+            good = good && *buf[i] == i;
+        }
+        expect(good);
+        for (auto ptr : buf) {
+            pool.deallocate(ptr);
+        }
+    };
+    "contents deallocated by a pool survive in persist mode"_test = [page_size] {
+        temp_file file;
+        constexpr const std::uint64_t count = 4096;
+        {
+            hvn::pool<std::uint64_t, hvn::mapped_file_allocator> pool(std::in_place,
+                                                                     file.path,
+                                                                     64 * page_size,
+                                                                     hvn::mapped_file_mode::persist);
+            std::vector<std::uint64_t*> buf;
+            for (std::uint64_t i = 0; i < count; ++i) {
+                buf.push_back(pool.allocate(i + 1));
+            }
+            for (auto ptr : buf) {
+                pool.deallocate(ptr);
+            }
+        }
+
+        // the pages of the pool are read back in whichever order it used them
+        hvn::mapped_file_allocator alloc(file.path, 64 * page_size);
+        auto page = alloc.allocate(64 * page_size);
+        const auto* words = reinterpret_cast<const std::uint64_t*>(page.base_addr());
+        std::vector<std::uint64_t> found;
+        std::copy_if(words, words + page.size() / sizeof(std::uint64_t), std::back_inserter(found), [](auto word) {
+            return word != 0;
+        });
+        std::ranges::sort(found);
+        auto good = found.size() == count;
+        for (std::uint64_t i = 0; good && i < count; ++i) {
+            good = found[i] == i + 1;
+        }
+        expect(good);
+        alloc.deallocate(page);
+    };
+    "persist mode reports contents it cannot keep"_test = [page_size] {
+        temp_file file;
+        hvn::mapped_file_allocator alloc(file.path, 16 * page_size, hvn::mapped_file_mode::persist);
+        auto page = alloc.allocate(page_size);
+        std::memcpy(page.base_addr(), test_bytes.data(), test_bytes.size());
+
+        // cutting the file off behind the allocator loses the page
+        std::filesystem::resize_file(file.path, 0);
+        expect(throws<std::system_error>([&alloc, page] { alloc.deallocate(page); }));
+    };
+};
@@ -0,0 +1,74 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-22.
+ *
+ * test/mem/owned_pool --
+ *   Test suite for the thread-owned pool.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/mem/owned-pool.hxx>
+
+using namespace boost::ut;
+
+namespace {
+    struct job {
+        std::uint64_t id;
+        std::uint64_t payload;
+    };
+}
+
+[[maybe_unused]] const suite owned_pool_suite = [] {
+    "owned pool grows past a single puddle"_test = [] {
+        hvn::owned_pool<job> pool;
+        expect(pool.is_owner());
+
+        std::vector<job*> jobs;
+        for (std::uint64_t i = 0; i < 2000; ++i) {
+            jobs.push_back(pool.allocate(i, i * 2));
+        }
+        expect(that % pool.puddle_count() > 1U);
+        for (auto ptr : jobs) {
+            expect(that % ptr->payload == ptr->id * 2);
+            pool.deallocate(ptr);
+        }
+    };
+
+    "jobs freed by other threads are reused"_test = [] {
+        hvn::owned_pool<job> pool;
+        constexpr const auto consumers = 4;
+        constexpr const auto jobs = 16384;
+        constexpr const auto batch_size = 1024;
+
+        std::atomic<int> bad_payloads = 0;
+        std::vector<job*> batch;
+        for (std::uint64_t i = 0; i < jobs; ++i) {
+            batch.push_back(pool.allocate(i, i * 2));
+            if (batch.size() < batch_size) continue;
+
+            std::vector<std::jthread> workers;
+            for (int c = 0; c < consumers; ++c) {
+                workers.emplace_back([&pool, &batch, &bad_payloads, c] {
+                    for (std::size_t j = c; j < batch.size(); j += consumers) {
+                        if (batch[j]->payload != batch[j]->id * 2) ++bad_payloads;
+                        pool.deallocate(batch[j]);
+                    }
+                });
+            }
+            workers.clear();
+            batch.clear();
+        }
+        expect(that % bad_payloads.load() == 0);
+        // every batch fits into the slots freed by the consumers before
+        auto per_puddle = hvn::page_allocator::page_size() / sizeof(job);
+        expect(that % pool.puddle_count() <= (batch_size + per_puddle - 1) / per_puddle);
+    };
+};
@@ -0,0 +1,188 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-22.
+ *
+ * test/mem/owned_puddle --
+ *   Test suite for the thread-owned puddle object.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/mem/owned-puddle.hxx>
+
+using namespace boost::ut;
+
+namespace {
+    struct job {
+        std::uint64_t id;
+        std::uint64_t payload;
+    };
+}
+
+[[maybe_unused]] const suite owned_puddle_suite = [] {
+    hvn::page_allocator alloc;
+
+    "owned puddle is owned by the constructing thread"_test = [&alloc] {
+        hvn::owned_puddle<job> puddle(&alloc);
+        expect(puddle.is_owner());
+        expect(puddle.owner() == std::this_thread::get_id());
+    };
+
+    "owner can allocate and deallocate"_test = [&alloc] {
+        hvn::owned_puddle<job> puddle(&alloc);
+        auto ptr = puddle.try_allocate(std::uint64_t{42}, std::uint64_t{69});
+        expect(that % ptr != nullptr);
+        expect(that % ptr->id == 42ULL);
+        expect(that % ptr->payload == 69ULL);
+        expect(puddle.deallocate(ptr));
+        expect(that % puddle.reclaim_remote() == 0u);
+    };
+
+    "owned puddle rejects foreign pointers"_test = [&alloc] {
+        hvn::owned_puddle<job> puddle(&alloc);
+        job foreign{};
+        expect(!puddle.deallocate(&foreign));
+    };
+
+    "remote frees are deferred until the owner reclaims them"_test = [&alloc] {
+        hvn::owned_puddle<job> puddle(&alloc);
+        std::vector<job*> buf;
+        std::ranges::generate_n(std::back_inserter(buf), puddle.capacity(), [&puddle] {
+            return puddle.try_allocate();
+        });
+        expect(std::ranges::all_of(buf, [](auto ptr) { return ptr != nullptr; }));
+
+        // the reporter is not thread-safe, results are checked by the main thread
+        std::atomic<std::size_t> freed = 0;
+        std::jthread([&puddle, &buf, &freed] {
+            for (auto ptr : buf) {
+                if (puddle.deallocate(ptr)) ++freed;
+            }
+        }).join();
+        expect(that % freed.load() == buf.size());
+
+        expect(that % puddle.reclaim_remote() == buf.size());
+        expect(that % puddle.reclaim_remote() == 0u);
+
+        buf.clear();
+        std::ranges::generate_n(std::back_inserter(buf), puddle.capacity(), [&puddle] {
+            return puddle.try_allocate();
+        });
+        expect(std::ranges::all_of(buf, [](auto ptr) { return ptr != nullptr; }));
+        for (auto ptr : buf) {
+            std::ignore = puddle.deallocate(ptr);
+        }
+    };
+
+    "full owned puddle reclaims remote frees on allocation miss"_test = [&alloc] {
+        hvn::owned_puddle<job> puddle(&alloc);
+        std::vector<job*> buf;
+        std::ranges::generate_n(std::back_inserter(buf), puddle.capacity(), [&puddle] {
+            return puddle.try_allocate();
+        });
+        expect(that % puddle.try_allocate() == nullptr);
+
+        auto remote = buf.back();
+        buf.pop_back();
+        std::atomic<bool> freed = false;
+        std::jthread([&puddle, remote, &freed] {
+            freed = puddle.deallocate(remote);
+        }).join();
+        expect(freed.load());
+
+        auto ptr = puddle.try_allocate();
+        expect(that % ptr == remote);
+        buf.push_back(ptr);
+
+        for (auto p : buf) {
+            std::ignore = puddle.deallocate(p);
+        }
+    };
+
+    "producer/consumer across threads"_test = [&alloc] {
+        hvn::owned_puddle<job> puddle(&alloc);
+        constexpr const auto consumers = 4;
+        constexpr const auto jobs = 16384;
+
+        std::vector<std::vector<job*>> handoff(consumers);
+        std::atomic<int> failures = 0;
+        std::uint64_t allocated = 0;
+        while (allocated < jobs) {
+            auto ptr = puddle.try_allocate(allocated, allocated * 2);
+            if (ptr == nullptr) {
+                std::vector<std::jthread> workers;
+                for (auto& batch : handoff) {
+                    workers.emplace_back([&puddle, &batch, &failures] {
+                        for (auto p : batch) {
+                            if (p->payload != p->id * 2) ++failures;
+                            if (!puddle.deallocate(p)) ++failures;
+                        }
+                        batch.clear();
+                    });
+                }
+                continue;
+            }
+            handoff[allocated % consumers].push_back(ptr);
+            ++allocated;
+        }
+        for (auto& batch : handoff) {
+            for (auto p : batch) {
+                std::ignore = puddle.deallocate(p);
+            }
+        }
+        expect(that % failures.load() == 0);
+        expect(that % puddle.reclaim_remote() == 0u);
+    };
+
+    "trim loans the page back once every slot is free"_test = [&alloc] {
+        hvn::owned_puddle<job> puddle(&alloc);
+        auto ptr = puddle.try_allocate();
+        std::jthread([&puddle, ptr] {
+            std::ignore = puddle.deallocate(ptr);
+        }).join();
+        puddle.trim();
+
+        ptr = puddle.try_allocate(std::uint64_t{1}, std::uint64_t{2});
+        expect(that % ptr != nullptr);
+        expect(that % ptr->payload == 2ULL);
+        expect(puddle.deallocate(ptr));
+    };
+    "remote frees race with the owner trimming"_test = [&alloc] {
+        hvn::owned_puddle<job> puddle(&alloc);
+        constexpr const auto rounds = 64;
+        constexpr const auto batch_size = 32;
+
+        std::atomic<int> failures = 0;
+        for (int round = 0; round < rounds; ++round) {
+            std::vector<job*> batch;
+            for (std::uint64_t i = 0; i < batch_size; ++i) {
+                batch.push_back(puddle.try_allocate(i, i * 2));
+            }
+
+            std::atomic<bool> freed = false;
+            std::jthread remote([&puddle, &batch, &failures, &freed] {
+                for (auto p : batch) {
+                    if (!puddle.deallocate(p)) ++failures;
+                }
+                freed = true;
+            });
+            // the owner keeps changing the state of the page meanwhile
+            while (!freed.load()) {
+                puddle.trim();
+                auto own = puddle.try_allocate();
+                if (own == nullptr || !puddle.deallocate(own)) ++failures;
+            }
+        }
+        puddle.trim();
+        expect(that % failures.load() == 0);
+    };
+};
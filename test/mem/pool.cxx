@@ -0,0 +1,185 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-23.
+ *
+ * test/mem/pool --
+ *   Test suite for the pool object.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <haven/mem/pool.hxx>
+
+using namespace boost::ut;
+
+namespace {
+    struct timer_node {
+        std::uint64_t deadline;
+        std::uint64_t job;
+    };
+}
+
+[[maybe_unused]] const suite pool_suite = [] {
+    "pool allocates and deallocates"_test = [] {
+        hvn::pool<timer_node> pool;
+        auto ptr = pool.allocate(std::uint64_t{42}, std::uint64_t{69});
+        expect(that % ptr != nullptr);
+        expect(that % ptr->deadline == 42ULL);
+        expect(that % ptr->job == 69ULL);
+        pool.deallocate(ptr);
+    };
+
+    "pool grows beyond a single puddle"_test = [] {
+        hvn::pool<timer_node> pool;
+        std::vector<timer_node*> buf;
+        for (std::uint64_t i = 0; i < 10'000; ++i) {
+            buf.push_back(pool.allocate(i, i));
+        }
+        expect(std::ranges::all_of(buf, [](auto ptr) { return ptr != nullptr; }));
+        expect(that % std::set(buf.begin(), buf.end()).size() == buf.size());
+        for (auto ptr : buf) {
+            pool.deallocate(ptr);
+        }
+    };
+
+    "pool handles are 32 bits wide"_test = [] {
+        expect(constant<sizeof(hvn::pool<timer_node>::handle_type) == sizeof(std::uint32_t)>);
+        expect(hvn::pool_handle{}.is_null());
+    };
+
+    "handles resolve to the allocated object"_test = [] {
+        hvn::pool<timer_node> pool;
+        std::vector<hvn::pool_handle> handles;
+        for (std::uint64_t i = 0; i < 10'000; ++i) {
+            handles.push_back(pool.allocate_handle(i, i * 2));
+        }
+
+        auto good = true;
+        for (std::uint64_t i = 0; i < handles.size(); ++i) {
+            auto ptr = pool.resolve(handles[i]);
+            good = good && ptr != nullptr && ptr->deadline == i && ptr->job == i * 2;
+        }
+        expect(good);
+
+        for (auto handle : handles) {
+            expect(pool.deallocate(handle));
+        }
+    };
+
+    "null handle resolves to null"_test = [] {
+        hvn::pool<timer_node> pool;
+        expect(that % pool.resolve(hvn::pool_handle{}) == nullptr);
+        expect(!pool.deallocate(hvn::pool_handle{}));
+    };
+
+    "generation tags detect stale handles"_test = [] {
+        hvn::pool<timer_node, hvn::page_allocator, hvn::packed_layout, 8> pool;
+        auto handle = pool.allocate_handle(std::uint64_t{1}, std::uint64_t{2});
+        expect(that % pool.resolve(handle) != nullptr);
+        expect(pool.deallocate(handle));
+
+        expect(that % pool.resolve(handle) == nullptr);
+        expect(!pool.deallocate(handle));
+
+        auto reused = pool.allocate_handle(std::uint64_t{3}, std::uint64_t{4});
+        expect(reused != handle);
+        expect(that % pool.resolve(handle) == nullptr);
+        expect(that % pool.resolve(reused)->deadline == 3ULL);
+        pool.deallocate(pool.resolve(reused));
+        expect(that % pool.resolve(reused) == nullptr);
+    };
+
+    "reserve makes room up front"_test = [] {
+        hvn::pool<timer_node> pool;
+        pool.reserve(10'000, hvn::page_prefault::populate);
+        auto capacity = pool.capacity();
+        expect(that % capacity >= 10'000U);
+
+        std::vector<timer_node*> buf;
+        for (std::uint64_t i = 0; i < 10'000; ++i) {
+            buf.push_back(pool.allocate(i, i));
+        }
+        expect(that % pool.capacity() == capacity);
+        for (auto ptr : buf) {
+            pool.deallocate(ptr);
+        }
+
+        pool.reserve(1);
+        expect(that % pool.capacity() == capacity);
+    };
+
+    "allocating the reserved count does not grow the pool"_test = [] {
+        hvn::pool<std::uint64_t> pool;
+        constexpr const auto count = std::size_t{50'000};
+        pool.reserve(count);
+        auto puddles = pool.puddle_count();
+        expect(that % pool.capacity() >= count);
+
+        std::vector<std::uint64_t*> buf;
+        for (std::uint64_t i = 0; i < count; ++i) {
+            buf.push_back(pool.allocate(i));
+        }
+        // no puddle was added, so no directory segment either
+        expect(that % pool.puddle_count() == puddles);
+        for (auto ptr : buf) {
+            pool.deallocate(ptr);
+        }
+    };
+
+    "every allocated object is enumerated"_test = [] {
+        hvn::pool<std::uint64_t> pool;
+        std::vector<std::uint64_t*> buf;
+        for (std::uint64_t i = 0; i < 2048; ++i) {
+            buf.push_back(pool.allocate(i));
+        }
+        for (std::size_t i = 0; i < buf.size(); i += 2) {
+            pool.deallocate(buf[i]);
+        }
+
+        std::set<std::uint64_t> seen;
+        pool.for_each_allocated([&seen, &pool](std::uint64_t* obj) {
+            seen.insert(*obj);
+            pool.deallocate(obj);
+        });
+        expect(that % seen.size() == 1024U);
+        expect(std::ranges::all_of(seen, [](auto value) { return value % 2 == 1; }));
+
+        std::size_t left = 0;
+        pool.for_each_allocated([&left](std::uint64_t*) { ++left; });
+        expect(that % left == 0U);
+    };
+
+    "multithreaded handle allocation"_test = [] {
+        hvn::pool<timer_node, hvn::page_allocator, hvn::packed_layout, 4> pool;
+        // the reporter is not thread-safe, results are checked by the main thread
+        std::atomic<int> failures = 0;
+        auto thr_function = [&pool, &failures](std::uint64_t seed) {
+            std::vector<hvn::pool_handle> handles;
+            for (std::uint64_t i = 0; i < 2048; ++i) {
+                handles.push_back(pool.allocate_handle(seed, i));
+            }
+            for (std::uint64_t i = 0; i < handles.size(); ++i) {
+                auto ptr = pool.resolve(handles[i]);
+                if (ptr == nullptr || ptr->deadline != seed || ptr->job != i) ++failures;
+                if (!pool.deallocate(handles[i])) ++failures;
+            }
+        };
+
+        {
+            std::vector<std::jthread> workers;
+            for (unsigned i = 0; i < std::max(2u, std::thread::hardware_concurrency()); ++i) {
+                workers.emplace_back(thr_function, i);
+            }
+        }
+        expect(that % failures.load() == 0);
+    };
+};
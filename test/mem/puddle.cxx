@@ -9,11 +9,16 @@
  *   Test suite for the puddle object.
  */
 
+#include <cstdint>
+#include <filesystem>
 #include <random>
+#include <set>
+#include <string>
 #include <thread>
 #include <tuple>
 
 #include <boost/ut.hpp>
+#include <haven/mem/mapped-file-allocator.hxx>
 #include <haven/mem/puddle.hxx>
 
 using namespace boost::ut;
@@ -29,109 +34,189 @@ namespace {
         bad_uint128 lower;
     };
     static_assert(sizeof(bad_uint256) == sizeof(bad_uint128) * 2);
-}
 
-[[maybe_unused]] const suite puddle_suite = [] {
-    "puddle is constructible with allocator pointer"_test = [] {
-        expect(constant<std::is_constructible_v<hvn::puddle<bad_uint128>, hvn::page_allocator*>>);
+    struct odd_triplet {
+        std::uint64_t a;
+        std::uint64_t b;
+        std::uint64_t c;
     };
 
-    hvn::page_allocator alloc;
-    "puddle can allocate a positive maximum amount of objects"_test = [&alloc] {
-        hvn::puddle<bad_uint128> puddle(&alloc);
-        expect(that % puddle.capacity() > 0u);
+    struct alignas(64) aligned64 {
+        std::uint64_t value;
     };
 
-    "puddle can store half amount of objects with twice the size"_test = [&alloc] {
-        hvn::puddle<bad_uint128> smaller(&alloc);
-        hvn::puddle<bad_uint256> bigger(&alloc);
-        expect(that % (bigger.capacity() * 2) == smaller.capacity());
+    struct alignas(128) aligned128 {
+        std::uint64_t value;
     };
 
-    "empty puddle"_test = [&alloc] {
-        hvn::puddle<bad_uint128> puddle(&alloc);
+    template<class P>
+    bool
+    fills_with_aligned_distinct_slots(P& puddle, std::size_t alignment) {
+        std::vector<typename P::value_type*> buf;
+        std::ranges::generate_n(std::back_inserter(buf), puddle.capacity(), [&puddle] {
+            return puddle.try_allocate();
+        });
 
-        decltype(puddle)::value_type* memory;
-        "allocation does not return nullptr"_test = [&puddle, &memory] {
-            memory = puddle.try_allocate();
-            expect(that % memory != nullptr);
+        auto good = std::ranges::all_of(buf, [alignment](auto ptr) {
+            return ptr != nullptr
+                   && reinterpret_cast<std::uintptr_t>(ptr) % alignment == 0;
+        });
+        good = good && std::set(buf.begin(), buf.end()).size() == buf.size();
+
+        for (auto ptr : buf) {
+            std::ignore = puddle.deallocate(ptr);
+        }
+        return good;
+    }
+
+    template<class Allocator>
+    void
+    puddle_tests(Allocator& alloc) {
+        "puddle is constructible with allocator pointer"_test = [] {
+            expect(constant<std::is_constructible_v<hvn::puddle<bad_uint128, Allocator>, Allocator*>>);
         };
 
-        "deallocation returns true for the same puddle"_test = [&puddle, memory] {
-            expect(puddle.deallocate(memory));
+        "puddle can allocate a positive maximum amount of objects"_test = [&alloc] {
+            hvn::puddle<bad_uint128, Allocator> puddle(&alloc);
+            expect(that % puddle.capacity() > 0u);
         };
 
-        "allocation can take parameters passed to the constructor"_test = [&puddle, &memory] {
-            memory = puddle.try_allocate(std::uint64_t{42}, std::uint64_t{69});
-            expect(that % memory != nullptr);
-            expect(that % memory->upper == 42ULL);
-            expect(that % memory->lower == 69ULL);
-            expect(puddle.deallocate(memory));
+        "puddle can store half amount of objects with twice the size"_test = [&alloc] {
+            hvn::puddle<bad_uint128, Allocator> smaller(&alloc);
+            hvn::puddle<bad_uint256, Allocator> bigger(&alloc);
+            expect(that % (bigger.capacity() * 2) == smaller.capacity());
         };
-    };
 
-    "full puddle"_test = [&alloc] {
-        hvn::puddle<bad_uint128> puddle(&alloc);
-        std::vector<bad_uint128*> buf;
+        "puddle hands out distinct slots when capacity is not a multiple of the simd width"_test = [&alloc] {
+            hvn::puddle<odd_triplet, Allocator> puddle(&alloc);
+            expect(fills_with_aligned_distinct_slots(puddle, alignof(odd_triplet)));
+        };
 
-        "puddle can allocate capacity amount of items"_test = [&puddle, &buf] {
-            std::ranges::generate_n(std::back_inserter(buf), puddle.capacity(), [&puddle] {
-                return puddle.try_allocate();
-            });
-            expect(std::ranges::all_of(buf, [](auto ptr) { return ptr != nullptr; }));
+        "packed puddle supports over-aligned types"_test = [&alloc] {
+            hvn::puddle<aligned64, Allocator> puddle64(&alloc);
+            hvn::puddle<aligned128, Allocator> puddle128(&alloc);
+            expect(that % puddle64.stride() == 64u);
+            expect(that % puddle128.stride() == 128u);
+            expect(fills_with_aligned_distinct_slots(puddle64, 64u));
+            expect(fills_with_aligned_distinct_slots(puddle128, 128u));
         };
 
-        "full puddle returns null on allocation"_test = [&puddle] {
-            auto failed_alloc = puddle.try_allocate();
-            expect(that % failed_alloc == nullptr);
+        "cache line layout pads every slot to the cache line"_test = [&alloc] {
+            using padded_puddle = hvn::puddle<bad_uint128, Allocator, hvn::cache_line_layout>;
+            auto cache_line = alloc.approx_cache_line1();
+            padded_puddle puddle(&alloc);
+            expect(that % (puddle.stride() % cache_line) == 0u);
+            expect(that % puddle.stride() >= sizeof(bad_uint128));
+            expect(fills_with_aligned_distinct_slots(puddle, cache_line));
         };
 
-        for (auto ptr : buf) {
-            std::ignore = puddle.deallocate(ptr);
-        }
-    };
+        "cache line layout respects alignment larger than the cache line"_test = [&alloc] {
+            using padded_puddle = hvn::puddle<aligned128, Allocator, hvn::cache_line_layout>;
+            padded_puddle puddle(&alloc);
+            expect(that % (puddle.stride() % 128u) == 0u);
+            expect(fills_with_aligned_distinct_slots(puddle, 128u));
+        };
 
-    "multithreaded functionality"_test = [&alloc] {
-        hvn::puddle<bad_uint128> puddle(&alloc);
-        auto thr_function = [](auto puddle_ptr) {
-            auto& puddle = *puddle_ptr;
+        "empty puddle"_test = [&alloc] {
+            hvn::puddle<bad_uint128, Allocator> puddle(&alloc);
+
+            typename decltype(puddle)::value_type* memory;
+            "allocation does not return nullptr"_test = [&puddle, &memory] {
+                memory = puddle.try_allocate();
+                expect(that % memory != nullptr);
+            };
+
+            "deallocation returns true for the same puddle"_test = [&puddle, memory] {
+                expect(puddle.deallocate(memory));
+            };
+
+            "allocation can take parameters passed to the constructor"_test = [&puddle, &memory] {
+                memory = puddle.try_allocate(std::uint64_t{42}, std::uint64_t{69});
+                expect(that % memory != nullptr);
+                expect(that % memory->upper == 42ULL);
+                expect(that % memory->lower == 69ULL);
+                expect(puddle.deallocate(memory));
+            };
+        };
+
+        "full puddle"_test = [&alloc] {
+            hvn::puddle<bad_uint128, Allocator> puddle(&alloc);
             std::vector<bad_uint128*> buf;
-            std::mt19937_64 rng(std::random_device{}());
-            std::uniform_int_distribution op(0, 1);
-            std::uniform_int_distribution<std::uint64_t> value(1ULL, 8192ULL);
-
-            for (int i = 0; i < 2048; ++i) {
-                if (op(rng) == 0) {
-                    auto nonnull = std::ranges::find_if_not(buf, [](auto ptr) { return ptr != nullptr; });
-                    if (nonnull != buf.end()) {
-                        auto ptr = *nonnull;
-                        *nonnull = nullptr;
-
-                        expect(that % ptr->upper != 0);
-                        expect(that % ptr->lower != 0);
-                        expect(puddle.deallocate(ptr));
+
+            "puddle can allocate capacity amount of items"_test = [&puddle, &buf] {
+                std::ranges::generate_n(std::back_inserter(buf), puddle.capacity(), [&puddle] {
+                    return puddle.try_allocate();
+                });
+                expect(std::ranges::all_of(buf, [](auto ptr) { return ptr != nullptr; }));
+            };
+
+            "full puddle returns null on allocation"_test = [&puddle] {
+                auto failed_alloc = puddle.try_allocate();
+                expect(that % failed_alloc == nullptr);
+            };
+
+            for (auto ptr : buf) {
+                std::ignore = puddle.deallocate(ptr);
+            }
+        };
+
+        "multithreaded functionality"_test = [&alloc] {
+            hvn::puddle<bad_uint128, Allocator> puddle(&alloc);
+            auto thr_function = [](auto puddle_ptr) {
+                auto& puddle = *puddle_ptr;
+                std::vector<bad_uint128*> buf;
+                std::mt19937_64 rng(std::random_device{}());
+                std::uniform_int_distribution op(0, 1);
+                std::uniform_int_distribution<std::uint64_t> value(1ULL, 8192ULL);
+
+                for (int i = 0; i < 2048; ++i) {
+                    if (op(rng) == 0) {
+                        auto nonnull = std::ranges::find_if_not(buf, [](auto ptr) { return ptr != nullptr; });
+                        if (nonnull != buf.end()) {
+                            auto ptr = *nonnull;
+                            *nonnull = nullptr;
+
+                            expect(that % ptr->upper != 0);
+                            expect(that % ptr->lower != 0);
+                            expect(puddle.deallocate(ptr));
+                        }
                     }
-                }
-                else {
-                    auto upper = value(rng);
-                    auto lower = value(rng);
-                    auto ptr = puddle.try_allocate(upper, lower);
-                    if (ptr != nullptr) { // puddle full
-                        expect(that % ptr->upper == upper);
-                        expect(that % ptr->lower == lower);
-                        buf.push_back(ptr);
+                    else {
+                        auto upper = value(rng);
+                        auto lower = value(rng);
+                        auto ptr = puddle.try_allocate(upper, lower);
+                        if (ptr != nullptr) { // puddle full
+                            expect(that % ptr->upper == upper);
+                            expect(that % ptr->lower == lower);
+                            buf.push_back(ptr);
+                        }
                     }
                 }
-            }
 
-            for (auto ptr : buf) {
-                std::ignore = puddle.deallocate(ptr);
+                for (auto ptr : buf) {
+                    std::ignore = puddle.deallocate(ptr);
+                }
+            };
+
+            std::vector<std::jthread> workers;
+            for (unsigned i = 0; i < std::thread::hardware_concurrency(); ++i) {
+                workers.emplace_back(thr_function, &puddle);
             }
         };
+    }
+}
 
-        std::vector<std::jthread> workers;
-        for (unsigned i = 0; i < std::thread::hardware_concurrency(); ++i) {
-            workers.emplace_back(thr_function, &puddle);
-        }
-    };
+[[maybe_unused]] const suite puddle_suite = [] {
+    hvn::page_allocator alloc;
+    puddle_tests(alloc);
+};
+
+[[maybe_unused]] const suite mapped_file_puddle_suite = [] {
+    auto path = std::filesystem::temp_directory_path()
+                / ("hvn-mem-tests-puddle-" + std::to_string(std::random_device{}()) + ".map");
+    {
+        hvn::mapped_file_allocator alloc(path, 1024 * hvn::mapped_file_allocator::page_size());
+        puddle_tests(alloc);
+    }
+    std::filesystem::remove(path);
 };
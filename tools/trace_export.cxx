@@ -0,0 +1,53 @@
+/* libhaven project
+ *
+ * Copyright (c) 2022 András Bodor
+ * All rights reserved.
+ *
+ * Originally created: 2022-11-28.
+ *
+ * tools/trace_export --
+ *   Converts a binary trace dump, as written by hvn::trace_dump, to the
+ *   Chrome trace JSON format, which can be opened in Perfetto or
+ *   chrome://tracing.
+ *
+ *   usage: hvn-trace-export <dump> [<output.json>]
+ *   Without an output file, the JSON is written to the standard output.
+ */
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+
+#include <haven/common/trace.hxx>
+
+int
+main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: " << argv[0] << " <dump> [<output.json>]\n";
+        return 2;
+    }
+
+    try {
+        std::ifstream input(argv[1], std::ios::binary);
+        if (!input) {
+            std::cerr << argv[0] << ": cannot open " << argv[1] << "\n";
+            return 1;
+        }
+        auto records = hvn::trace_load(input);
+
+        if (argc == 3) {
+            std::ofstream output(argv[2]);
+            if (!output) {
+                std::cerr << argv[0] << ": cannot open " << argv[2] << "\n";
+                return 1;
+            }
+            hvn::trace_write_chrome_json(output, records);
+        }
+        else {
+            hvn::trace_write_chrome_json(std::cout, records);
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << argv[0] << ": " << ex.what() << "\n";
+        return 1;
+    }
+}